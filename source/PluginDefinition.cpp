@@ -22,6 +22,10 @@
 #include <string>
 #include "SrtToolsPanel.h"
 
+#undef max
+#undef min
+#include "SrtScintilla.h"
+
 //
 // The plugin data that Notepad++ needs
 //
@@ -35,6 +39,7 @@ NppData nppData;
 PluginConfig pluginConfig;
 std::wstring confPath;
 SrtToolPanel toolPanelInstance;
+SrtDocumentCache documentCache;
 
 //
 // Initialize your plugin data here
@@ -110,6 +115,46 @@ HWND getCurrentScintillaHandle() {
 	return (currentEdit == 0)?nppData._scintillaMainHandle:nppData._scintillaSecondHandle;
 }
 
+ScintillaCaller getScintillaCaller(HWND hScintilla)
+{
+	SciFnDirect function = (SciFnDirect)::SendMessage(hScintilla, SCI_GETDIRECTFUNCTION, 0, 0);
+	sptr_t pointer = (sptr_t)::SendMessage(hScintilla, SCI_GETDIRECTPOINTER, 0, 0);
+	return ScintillaCaller(function, pointer);
+}
+
+// Buffer shown in a view, which is the one modified when the view sends SCN_MODIFIED
+UINT_PTR getViewBufferId(int view)
+{
+	LRESULT docIndex = ::SendMessage(nppData._nppHandle, NPPM_GETCURRENTDOCINDEX, 0, view);
+	return (UINT_PTR)::SendMessage(nppData._nppHandle, NPPM_GETBUFFERIDFROMPOS, docIndex, view);
+}
+
+void onScintillaModified(SCNotification *notification)
+{
+	// Nothing to update until operations are applied to a document
+	if (documentCache.IsEmpty() || !(notification->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)))
+		return;
+
+	HWND hScintilla = (HWND)notification->nmhdr.hwndFrom;
+	if (hScintilla != nppData._scintillaMainHandle && hScintilla != nppData._scintillaSecondHandle)
+		return;
+
+	int view = (hScintilla == nppData._scintillaMainHandle) ? MAIN_VIEW : SUB_VIEW;
+	documentCache.OnModified(getViewBufferId(view), getScintillaCaller(hScintilla), *notification);
+}
+
+void onFileClosed(UINT_PTR bufferId)
+{
+	documentCache.Remove(bufferId);
+}
+
+size_t applySrtOperations(const SrtStreamOperations& operations)
+{
+	HWND hCurrScintilla = getCurrentScintillaHandle();
+	UINT_PTR bufferId = (UINT_PTR)::SendMessage(nppData._nppHandle, NPPM_GETCURRENTBUFFERID, 0, 0);
+	return documentCache.ApplyOperations(bufferId, getScintillaCaller(hCurrScintilla), operations);
+}
+
 const TCHAR *pluginConfName = TEXT("srttool.ini");
 const TCHAR *srtToolsxSectionName = TEXT("SrtTools");
 const TCHAR *removeExtraText = TEXT("removeExtraText");
@@ -128,4 +128,10 @@ void menu_displayToolPanel();
 void menu_editConfigFile();
 void menu_displayAboutDialog();
 
+//
+// Keep the subtitle positions of the open documents up to date
+//
+void onScintillaModified(SCNotification *notification);
+void onFileClosed(UINT_PTR bufferId);
+
 #endif //PLUGINDEFINITION_H
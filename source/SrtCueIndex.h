@@ -0,0 +1,317 @@
+// ----------------------------------------------------------------------------
+// SrtCueIndex.h
+// Positions of the subtitles in a document being edited, by Louis de Carufel.
+//
+// The index is built by parsing the whole document once, then follows the
+// insertions and deletions made in the document. Positions after an edit
+// are shifted lazily, so a series of edits in the same area costs the same
+// whatever the size of the document. When the index is next used, only the
+// modified area is parsed again, until the subtitles found line up with the
+// ones already known.
+//
+// The subtitles found are always the ones SrtFile finds in the whole document.
+//
+// Usage example:
+//
+//  SrtCueIndex cueIndex;
+//  auto getText = [&](size_t start) { return std::string_view(text).substr(start); };
+//  cueIndex.Update(getText);
+//  text.insert(position, "Hello");
+//  cueIndex.OnInsert(position, 5, text.size());
+//  cueIndex.Update(getText);
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "SrtFile.h"
+
+class SrtCueIndex
+{
+public:
+    struct Cue
+    {
+        size_t m_start;         // Start of the extra text before the subtitle, where the previous subtitle ends
+        size_t m_indexStart;    // Start of the index line
+    };
+
+    void Clear()
+    {
+        *this = {};
+    }
+
+    bool IsUpToDate() const
+    {
+        return m_built && !m_modified;
+    }
+
+    size_t GetCueCount() const
+    {
+        return m_built ? m_cues.size() - 1 : 0;
+    }
+
+    Cue GetCue(size_t cue) const
+    {
+        Cue position = m_cues[cue];
+        if (cue >= m_shiftStart)
+            AddToCue(position, m_shift);
+        return position;
+    }
+
+    // Position after the last text line of the subtitle, where the blank line that ends it starts.
+    size_t GetCueEnd(size_t cue) const
+    {
+        return GetCue(cue + 1).m_start;
+    }
+
+    // Returns the first subtitle whose index line starts at or after the position, or GetCueCount() if none.
+    size_t FindCue(size_t position) const
+    {
+        size_t first = 0;
+        size_t count = GetCueCount();
+        while (count > 0)
+        {
+            const size_t half = count / 2;
+            if (GetCue(first + half).m_indexStart < position)
+            {
+                first += half + 1;
+                count -= half + 1;
+            }
+            else
+            {
+                count = half;
+            }
+        }
+        return first;
+    }
+
+    // To call after text is inserted in the document, with the new length of the document.
+    void OnInsert(size_t position, size_t length, size_t documentLength)
+    {
+        if (!AcceptEdit(documentLength, m_length + length))
+            return;
+
+        // Subtitles after the insertion move, the one containing it is parsed again
+        const size_t nextCue = FindStart(position + 1);
+        MoveShift(nextCue);
+        m_shift += length;
+        if (nextCue > 0 && m_cues[nextCue - 1].m_indexStart > position)
+            m_cues[nextCue - 1].m_indexStart += length;
+
+        auto Move = [=](size_t x) { return x > position ? x + length : x; };
+        SetModified(Move, position, position + length);
+    }
+
+    // To call after text is deleted from the document, with the new length of the document.
+    void OnDelete(size_t position, size_t length, size_t documentLength)
+    {
+        if (!AcceptEdit(documentLength, m_length - length))
+            return;
+
+        // Subtitles after the deletion move back, positions inside it move to its start
+        const size_t end = position + length;
+        const size_t firstCue = FindStart(position + 1);
+        const size_t nextCue = FindStart(end);
+        MoveShift(nextCue);
+        m_shift -= length;
+
+        auto Move = [=](size_t x) { return x >= end ? x - length : std::min(x, position); };
+        for (size_t cue = firstCue > 0 ? firstCue - 1 : 0; cue < nextCue; cue++)
+        {
+            m_cues[cue].m_start = Move(m_cues[cue].m_start);
+            m_cues[cue].m_indexStart = Move(m_cues[cue].m_indexStart);
+        }
+        SetModified(Move, position, position);
+    }
+
+    // Brings the index up to date, by parsing the whole document the first time,
+    // then only the areas modified since the last update.
+    // getText(start) must return the text of the document from start to its end.
+    template <typename GetText>
+    void Update(GetText getText)
+    {
+        if (IsUpToDate())
+            return;
+
+        if (!m_built)
+        {
+            m_cues.assign(1, Cue{ 0, 0 });
+            m_shift = 0;
+            m_shiftStart = 0;
+            m_modifiedStart = 0;
+            m_modifiedEnd = std::string_view::npos;
+        }
+
+        // The subtitle before the first modified one is also parsed again, since
+        // the blank line that ends it can be changed by the modification
+        const size_t modifiedCue = FindStart(m_modifiedStart);
+        const size_t firstCue = modifiedCue >= 2 ? modifiedCue - 2 : 0;
+        const size_t start = GetCue(firstCue).m_start;
+        const std::string_view text = getText(start);
+
+        // A missed edit, start over
+        if (m_built && start + text.size() != m_length)
+        {
+            m_built = false;
+            Update(getText);
+            return;
+        }
+
+        // Parse until a subtitle ends where an unmodified one starts, after the modified area.
+        // The parser only looks forward, so all the subtitles from there are unchanged.
+        SrtFileInternal::LineReader reader(text);
+        SrtSubtitle subtitle;
+        size_t cueStart = start;
+        size_t oldCue = firstCue + 1;
+        bool foundOldCue = false;
+        m_newCues.clear();
+        while (subtitle.ReadFromBuffer(reader))
+        {
+            m_newCues.push_back({ cueStart, cueStart + subtitle.m_extra.size() });
+            subtitle.Clear();
+
+            cueStart = start + reader.GetPosition();
+            if (cueStart > m_modifiedEnd)
+            {
+                while (oldCue < m_cues.size() && GetCue(oldCue).m_start < cueStart)
+                    oldCue++;
+                if (oldCue < m_cues.size() && GetCue(oldCue).m_start == cueStart)
+                {
+                    foundOldCue = true;
+                    break;
+                }
+            }
+        }
+
+        // Without a match, the rest of the document was parsed and ends with the trailing extra text
+        if (!foundOldCue)
+        {
+            m_newCues.push_back({ cueStart, cueStart });
+            oldCue = m_cues.size();
+        }
+
+        ReplaceCues(firstCue, oldCue, m_newCues);
+        m_length = start + text.size();
+        m_built = true;
+        m_modified = false;
+    }
+
+    // Replaces the subtitles of an area of the document that was just rewritten, so it is not parsed again.
+    // The index must have been up to date before the rewrite, and the rewritten subtitles replace
+    // the ones from firstCue to endCue. cuesEnd is the end of the last one, where the next subtitle
+    // or the trailing extra text now starts.
+    void OnRewrite(size_t firstCue, size_t endCue, const std::vector<Cue>& cues, size_t cuesEnd, size_t documentLength)
+    {
+        if (!m_built || documentLength != m_length)
+        {
+            m_built = false;
+            return;
+        }
+
+        // Positions at the end of the replaced text were moved to its start, put them after the new text
+        MoveShift(endCue + 1);
+        Cue& nextCue = m_cues[endCue];
+        nextCue.m_start = cuesEnd;
+        nextCue.m_indexStart = std::max(nextCue.m_indexStart, cuesEnd);
+
+        ReplaceCues(firstCue, endCue, cues);
+        m_modified = false;
+    }
+
+private:
+    static void AddToCue(Cue& cue, size_t offset)
+    {
+        cue.m_start += offset;
+        cue.m_indexStart += offset;
+    }
+
+    // Edits are notified once for each view showing the document, so the ones already applied are ignored.
+    // Any other difference in length means an edit was missed, and the index is built again when next used.
+    bool AcceptEdit(size_t documentLength, size_t expectedLength)
+    {
+        if (!m_built || documentLength == m_length)
+            return false;
+
+        if (documentLength != expectedLength)
+        {
+            m_built = false;
+            return false;
+        }
+
+        m_length = documentLength;
+        return true;
+    }
+
+    template <typename Move>
+    void SetModified(Move move, size_t start, size_t end)
+    {
+        if (m_modified)
+        {
+            start = std::min(move(m_modifiedStart), start);
+            end = std::max(move(m_modifiedEnd), end);
+        }
+        m_modifiedStart = start;
+        m_modifiedEnd = end;
+        m_modified = true;
+    }
+
+    // Returns the first subtitle starting at or after the position, counting the end of the last subtitle.
+    size_t FindStart(size_t position) const
+    {
+        size_t first = 0;
+        size_t count = m_cues.size();
+        while (count > 0)
+        {
+            const size_t half = count / 2;
+            if (GetCue(first + half).m_start < position)
+            {
+                first += half + 1;
+                count -= half + 1;
+            }
+            else
+            {
+                count = half;
+            }
+        }
+        return first;
+    }
+
+    // The pending shift applies to the positions of all subtitles from m_shiftStart.
+    // Moving its start only updates the subtitles in between, which are few when edits are close together.
+    void MoveShift(size_t cue)
+    {
+        if (m_shift == 0)
+        {
+            m_shiftStart = cue;
+            return;
+        }
+
+        for (; m_shiftStart < cue; m_shiftStart++)
+            AddToCue(m_cues[m_shiftStart], m_shift);
+        while (m_shiftStart > cue)
+            AddToCue(m_cues[--m_shiftStart], 0 - m_shift);
+    }
+
+    void ReplaceCues(size_t firstCue, size_t endCue, const std::vector<Cue>& cues)
+    {
+        MoveShift(endCue);
+        const size_t oldCount = endCue - firstCue;
+        if (cues.size() > oldCount)
+            m_cues.insert(m_cues.begin() + (ptrdiff_t)endCue, cues.size() - oldCount, Cue{});
+        else
+            m_cues.erase(m_cues.begin() + (ptrdiff_t)(firstCue + cues.size()), m_cues.begin() + (ptrdiff_t)endCue);
+        std::copy(cues.begin(), cues.end(), m_cues.begin() + (ptrdiff_t)firstCue);
+        m_shiftStart = firstCue + cues.size();
+    }
+
+    // One more entry than subtitles, for the end of the last one
+    std::vector<Cue> m_cues;
+    std::vector<Cue> m_newCues;
+    size_t m_length = 0;
+    bool m_built = false;
+
+    size_t m_shift = 0;             // Added to positions from m_shiftStart, wrapping around for deletions
+    size_t m_shiftStart = 0;
+
+    bool m_modified = false;
+    size_t m_modifiedStart = 0;
+    size_t m_modifiedEnd = 0;
+};
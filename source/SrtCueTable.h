@@ -0,0 +1,270 @@
+// ----------------------------------------------------------------------------
+// SrtCueTable.h
+// Columnar storage for SRT subtitles, by Louis de Carufel.
+//
+// Alternative to SrtFile for bulk timing edits on large files.
+// Indices, start times and end times are kept in separate contiguous arrays,
+// and all the subtitle text is copied once into a single shared buffer.
+// Timing edits only touch the arrays they need, with the bulk timing
+// kernels of SrtFileInternal (AVX2 when available).
+//
+// Usage example:
+//
+//  SrtCueTable cueTable;
+//  cueTable.ReadFromBuffer(fileContents);
+//  cueTable.OffsetInMilliseconds(-2000);
+//  cueTable.Renumber(1);
+//  cueTable.WriteToFile(outputStream);
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "SrtFile.h"
+
+class SrtCueTable
+{
+public:
+    SrtCueTable() = default;
+    SrtCueTable(std::string_view buffer)
+    {
+        ReadFromBuffer(buffer);
+    }
+    SrtCueTable(const SrtFile& srtFile)
+    {
+        for (const SrtSubtitle& subtitle : srtFile.m_subtitles)
+            AddSubtitle(subtitle);
+        SetExtra(srtFile.m_extra);
+    }
+
+    void Clear()
+    {
+        *this = {};
+    }
+
+    bool IsValid() const
+    {
+        return !m_indices.empty();
+    }
+
+    size_t GetCueCount() const
+    {
+        return m_indices.size();
+    }
+
+    // Reads an SRT file from a buffer. The text is copied, so the buffer can be released afterwards.
+    bool ReadFromBuffer(std::string_view buffer)
+    {
+        m_text.reserve(m_text.size() + buffer.size());
+
+        SrtFileInternal::LineReader reader(buffer);
+        SrtSubtitle subtitle;
+        while (subtitle.ReadFromBuffer(reader))
+        {
+            AddSubtitle(subtitle);
+            subtitle.Clear();
+        }
+        SetExtra(subtitle.m_extra);
+
+        return IsValid();
+    }
+
+    // Reads an SRT file from the given stream.
+    bool ReadFromFile(std::istream& stream)
+    {
+        if (!stream.good())
+            return false;
+
+        std::string buffer;
+        SrtFileInternal::ReadStream(stream, buffer);
+        return ReadFromBuffer(buffer);
+    }
+
+    void WriteToFile(std::ostream& stream, bool ignoreExtra = false) const
+    {
+        if (!IsValid() || !stream.good())
+            return;
+
+        SrtFileInternal::OutputBuffer output(stream);
+        WriteToOutput(output, ignoreExtra);
+    }
+
+    // Same behavior as SrtFile::ComputeSerializedSize.
+    size_t ComputeSerializedSize(bool ignoreExtra = false) const
+    {
+        SrtFileInternal::OutputSizeCounter output;
+        WriteToOutput(output, ignoreExtra);
+        return output.GetSize();
+    }
+
+    // Same behavior as SrtFile::WriteToBuffer.
+    size_t WriteToBuffer(char* buffer, size_t size, bool ignoreExtra = false) const
+    {
+        SrtFileInternal::FixedOutputBuffer output(buffer, size);
+        WriteToOutput(output, ignoreExtra);
+        return output.HasOverflowed() ? 0 : output.GetSize();
+    }
+
+    template <typename Output>
+    void WriteToOutput(Output& output, bool ignoreExtra = false) const
+    {
+        if (!IsValid())
+            return;
+
+        for (size_t cue = 0; cue < GetCueCount(); cue++)
+        {
+            if (!ignoreExtra)
+                output.Append(GetExtra(cue));
+
+            output.AppendNumber(m_indices[cue]);
+            output.Append('\n');
+
+            output.AppendTimeCode(m_startTimes[cue]);
+            output.Append(" --> ");
+            output.AppendTimeCode(m_endTimes[cue]);
+            std::string_view coordinates = GetCoordinates(cue);
+            if (!coordinates.empty())
+            {
+                output.Append(' ');
+                output.Append(coordinates);
+            }
+            output.Append('\n');
+
+            output.Append(GetText(cue));
+            if (ignoreExtra)
+                output.Append('\n');
+            output.FlushIfFull();
+        }
+
+        if (!ignoreExtra)
+            output.Append(GetExtra(GetCueCount()));
+    }
+
+    // Offset the timecode of all subtitle by the given number of milliseconds.
+    // Same behavior as SrtFile::OffsetInMilliseconds.
+    void OffsetInMilliseconds(long offset)
+    {
+        if (offset < 0 && !m_startTimes.empty())
+            offset = -std::min((long)m_startTimes[0], -offset);
+
+        SrtFileInternal::OffsetTimes(m_startTimes.data(), GetCueCount(), offset);
+        SrtFileInternal::OffsetTimes(m_endTimes.data(), GetCueCount(), offset);
+    }
+
+    // Same behavior as SrtFile::ScaleTimes.
+    void ScaleTimes(double scale)
+    {
+        RemapTimes(scale, 0L);
+    }
+
+    // Same behavior as SrtFile::RemapTimes.
+    void RemapTimes(double scale, long offset)
+    {
+        SrtFileInternal::RemapTimes(m_startTimes.data(), GetCueCount(), scale, (double)offset);
+        SrtFileInternal::RemapTimes(m_endTimes.data(), GetCueCount(), scale, (double)offset);
+    }
+
+    // Same behavior as SrtFile::ConvertFrameRate.
+    void ConvertFrameRate(const SrtFrameRateConversion& conversion)
+    {
+        conversion.ConvertTimes(m_startTimes.data(), m_endTimes.data(), GetCueCount());
+    }
+
+    // Same behavior as SrtFile::Resync.
+    void Resync(const SrtResyncMap& map)
+    {
+        map.MapTimes(m_startTimes.data(), GetCueCount());
+        map.MapTimes(m_endTimes.data(), GetCueCount());
+    }
+
+    void ClampTimes()
+    {
+        SrtFileInternal::ClampTimes(m_startTimes.data(), GetCueCount());
+        SrtFileInternal::ClampTimes(m_endTimes.data(), GetCueCount());
+    }
+
+    // Renumbers all subtitles sequentially, starting at the specified index.
+    // Returns the index of the last subtitle.
+    long Renumber(long startIndex = 1L)
+    {
+        startIndex = std::max(startIndex, 1L);
+        const size_t count = GetCueCount();
+        long* indices = m_indices.data();
+        for (size_t cue = 0; cue < count; cue++)
+            indices[cue] = startIndex + (long)cue;
+        return startIndex + ((long)count - 1);
+    }
+
+    // Text that precedes a subtitle. Use GetCueCount() as the cue to get the text after the last subtitle.
+    std::string_view GetExtra(size_t cue) const
+    {
+        const size_t end = cue < GetCueCount() ? m_coordinatesOffsets[cue] : m_text.size();
+        return GetTextRange(m_extraOffsets[cue], end);
+    }
+
+    std::string_view GetCoordinates(size_t cue) const
+    {
+        return GetTextRange(m_coordinatesOffsets[cue], m_textOffsets[cue]);
+    }
+
+    // All the text lines of a subtitle, each followed by a newline.
+    std::string_view GetText(size_t cue) const
+    {
+        return GetTextRange(m_textOffsets[cue], m_extraOffsets[cue + 1]);
+    }
+
+public:
+    // Timing columns, in milliseconds
+    std::vector<int32_t> m_startTimes;
+    std::vector<int32_t> m_endTimes;
+    std::vector<long> m_indices;    // Same type as SrtSubtitle::m_index
+
+private:
+    void AddSubtitle(const SrtSubtitle& subtitle)
+    {
+        m_indices.push_back(subtitle.m_index);
+        m_startTimes.push_back((int32_t)subtitle.m_startTime.GetMilliseconds());
+        m_endTimes.push_back((int32_t)subtitle.m_endTime.GetMilliseconds());
+
+        // Text of a subtitle is stored as extra, coordinates, then text lines.
+        // The extra offset of the next subtitle marks the end of the text lines.
+        AppendText(subtitle.m_extra, true);
+        m_coordinatesOffsets.push_back(m_text.size());
+        AppendText(subtitle.m_coordinates, false);
+        m_textOffsets.push_back(m_text.size());
+        AppendText(subtitle.m_text, true);
+        m_extraOffsets.push_back(m_text.size());
+    }
+
+    void SetExtra(std::string_view extra)
+    {
+        m_text.resize(m_extraOffsets.back());
+        AppendText(extra, true);
+    }
+
+    // Appends text without carriage returns, ending with a newline if asked.
+    void AppendText(std::string_view text, bool endWithNewline)
+    {
+        if (text.empty())
+            return;
+
+        size_t pos = 0;
+        while (pos < text.size())
+        {
+            size_t crPos = std::min(text.find('\r', pos), text.size());
+            m_text.append(text.data() + pos, crPos - pos);
+            pos = crPos + 1;
+        }
+
+        if (endWithNewline && m_text.back() != '\n')
+            m_text.push_back('\n');
+    }
+
+    std::string_view GetTextRange(size_t start, size_t end) const
+    {
+        return std::string_view(m_text).substr(start, end - start);
+    }
+
+    std::string m_text;
+    std::vector<size_t> m_extraOffsets = { 0 };
+    std::vector<size_t> m_coordinatesOffsets;
+    std::vector<size_t> m_textOffsets;
+};
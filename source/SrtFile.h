@@ -1,12 +1,22 @@
 // ----------------------------------------------------------------------------
-// SrtFile.h (v1.1)
+// SrtFile.h (v1.2)
 // Simple SRT file library, by Louis de Carufel.
 //
 // Can be used to parse an SRT file, renumber the subtitles,
 // offset timecodes forwards or backwards, and back write into
 // an SRT file.
 //
-// The streams can be std::fstream or std::stringstream. 
+// The input can be a std::istream (std::fstream or std::stringstream),
+// a contiguous buffer already in memory, or a file mapped in memory.
+// When parsing a buffer, the subtitle text is not copied: the subtitles
+// refer directly to the buffer, which must stay alive as long as the
+// SrtFile is used, unless it is a temporary std::string, which the file
+// keeps. New text is copied into the file with SrtFile::SetText and the
+// other setters. Large inputs can be parsed on several threads.
+// Times can also be scaled, resynced from anchor times, or converted
+// between frame rates with exact ratios. Timing changes can be patched
+// directly into the buffer or mapped file, without writing the rest of the
+// file again.
 //
 // Usage example:
 //
@@ -26,351 +36,2778 @@
 #pragma once
 #include <iostream>
 #include <vector>
+#include <deque>
+#include <memory>
 #include <string>
-#include <stdarg.h>
+#include <string_view>
+#include <cstdio>
+#include <cstring>
 #include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <cmath>
+#include <climits>
+#include <numeric>
+
+// Line scanning uses SSE2 or AVX2 when the compiler targets them.
+// Define SRTFILE_NO_SIMD to force the scalar implementation.
+#if !defined(SRTFILE_NO_SIMD) && defined(__AVX2__)
+    #define SRTFILE_SIMD_AVX2
+    #include <immintrin.h>
+#elif !defined(SRTFILE_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define SRTFILE_SIMD_SSE2
+    #include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+// Define SRTFILE_STATS to count what the parser and writer do, see SrtStats.
+// Without it, the counting code is not compiled at all.
+#if defined(SRTFILE_STATS)
+    #include <chrono>
+    #define SRTFILE_STAT(...) __VA_ARGS__
+#else
+    #define SRTFILE_STAT(...)
+#endif
+
+// Large buffers can be parsed on several threads.
+// Define SRTFILE_NO_THREADS to always parse on the calling thread.
+#if !defined(SRTFILE_NO_THREADS)
+    #include <thread>
+#endif
+
+#if defined(_WIN32)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// Parser and writer counters, filled only when SRTFILE_STATS is defined.
+struct SrtStats
+{
+    uint64_t m_bytesScanned = 0;
+    uint64_t m_linesRead = 0;
+    uint64_t m_cuesAccepted = 0;
+    uint64_t m_extraLines = 0;          // Lines kept as extra text, outside of subtitles
+    uint64_t m_subtitleLines = 0;       // Index, timing and text lines of the accepted subtitles
+    uint64_t m_timingFailures = 0;      // Lines with an arrow after an index, that are not valid timing lines
+    uint64_t m_endTimeFixups = 0;       // Subtitles ending before they start, fixed to last 1 ms
+    uint64_t m_subtitleArrayGrowths = 0; // Times the subtitle array was reallocated
+    uint64_t m_bytesWritten = 0;
+    double m_readSeconds = 0.0;         // Reading the stream or mapping the file
+    double m_parseSeconds = 0.0;
+    double m_writeSeconds = 0.0;
+
+    void Add(const SrtStats& other)
+    {
+        m_bytesScanned += other.m_bytesScanned;
+        m_linesRead += other.m_linesRead;
+        m_cuesAccepted += other.m_cuesAccepted;
+        m_extraLines += other.m_extraLines;
+        m_subtitleLines += other.m_subtitleLines;
+        m_timingFailures += other.m_timingFailures;
+        m_endTimeFixups += other.m_endTimeFixups;
+        m_subtitleArrayGrowths += other.m_subtitleArrayGrowths;
+        m_bytesWritten += other.m_bytesWritten;
+        m_readSeconds += other.m_readSeconds;
+        m_parseSeconds += other.m_parseSeconds;
+        m_writeSeconds += other.m_writeSeconds;
+    }
+};
 
 namespace SrtFileInternal
 {
-    bool ReadLine(std::istream& stream, std::string& str)
+#if defined(SRTFILE_STATS)
+    // Adds the time spent in a scope to a stats timer.
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer(double& seconds) : m_seconds(seconds), m_start(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer()
+        {
+            m_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        }
+
+    private:
+        double& m_seconds;
+        std::chrono::steady_clock::time_point m_start;
+    };
+#endif
+
+    inline unsigned CountTrailingZeros(uint32_t mask)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (unsigned)index;
+#else
+        return (unsigned)__builtin_ctz(mask);
+#endif
+    }
+
+    struct LineInfo
+    {
+        size_t start;   // Offset of the first character
+        size_t end;     // Offset after the last character, without end of line characters
+        size_t next;    // Offset of the next line
+        bool hasArrow;  // The line contains a "-->" timecode arrow
+    };
+
+    // Splits the buffer into lines starting at the given position, and flags the lines with an arrow.
+    // Newlines and arrows are found in a single pass over the buffer. Stops after maxLines lines.
+    inline size_t ScanLines(std::string_view buffer, size_t position, LineInfo* lines, size_t maxLines)
+    {
+        const char* data = buffer.data();
+        const size_t size = buffer.size();
+        size_t lineCount = 0;
+        size_t lineStart = position;
+        bool hasArrow = false;
+
+        auto AddLine = [&](size_t lineEnd, size_t next)
+        {
+            while (lineEnd > lineStart && data[lineEnd - 1] == '\r')
+                lineEnd--;
+            lines[lineCount++] = { lineStart, lineEnd, next, hasArrow };
+            lineStart = next;
+            hasArrow = false;
+        };
+
+#if defined(SRTFILE_SIMD_AVX2) || defined(SRTFILE_SIMD_SSE2)
+#if defined(SRTFILE_SIMD_AVX2)
+        const size_t blockSize = 32;
+        const __m256i newlines = _mm256_set1_epi8('\n');
+        const __m256i dashes = _mm256_set1_epi8('-');
+        const __m256i arrowHeads = _mm256_set1_epi8('>');
+#else
+        const size_t blockSize = 16;
+        const __m128i newlines = _mm_set1_epi8('\n');
+        const __m128i dashes = _mm_set1_epi8('-');
+        const __m128i arrowHeads = _mm_set1_epi8('>');
+#endif
+        // The arrow test reads two bytes past the block
+        for (size_t pos = position; pos + blockSize + 2 <= size; pos += blockSize)
+        {
+#if defined(SRTFILE_SIMD_AVX2)
+            const __m256i block0 = _mm256_loadu_si256((const __m256i*)(data + pos));
+            const __m256i block1 = _mm256_loadu_si256((const __m256i*)(data + pos + 1));
+            const __m256i block2 = _mm256_loadu_si256((const __m256i*)(data + pos + 2));
+            const uint32_t newlineMask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block0, newlines));
+            const uint32_t arrowMask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(
+                _mm256_and_si256(_mm256_cmpeq_epi8(block0, dashes), _mm256_cmpeq_epi8(block1, dashes)),
+                _mm256_cmpeq_epi8(block2, arrowHeads)));
+#else
+            const __m128i block0 = _mm_loadu_si128((const __m128i*)(data + pos));
+            const __m128i block1 = _mm_loadu_si128((const __m128i*)(data + pos + 1));
+            const __m128i block2 = _mm_loadu_si128((const __m128i*)(data + pos + 2));
+            const uint32_t newlineMask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block0, newlines));
+            const uint32_t arrowMask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(
+                _mm_and_si128(_mm_cmpeq_epi8(block0, dashes), _mm_cmpeq_epi8(block1, dashes)),
+                _mm_cmpeq_epi8(block2, arrowHeads)));
+#endif
+            // Visit newlines and arrows in buffer order
+            uint32_t mask = newlineMask | arrowMask;
+            while (mask != 0)
+            {
+                const unsigned bit = CountTrailingZeros(mask);
+                mask &= mask - 1;
+                if (newlineMask & (1u << bit))
+                {
+                    AddLine(pos + bit, pos + bit + 1);
+                    if (lineCount == maxLines)
+                        return lineCount;
+                }
+                else
+                {
+                    hasArrow = true;
+                }
+            }
+        }
+#endif
+
+        // Scalar scan of the remaining lines, restarting at the current line
+        while (lineStart < size && lineCount < maxLines)
+        {
+            const char* newline = (const char*)std::memchr(data + lineStart, '\n', size - lineStart);
+            const size_t lineEnd = newline ? (size_t)(newline - data) : size;
+            hasArrow = buffer.substr(lineStart, lineEnd - lineStart).find("-->") != std::string_view::npos;
+            AddLine(lineEnd, newline ? lineEnd + 1 : size);
+        }
+
+        return lineCount;
+    }
+
+    // Reads lines from a contiguous buffer without copying them.
+    // Returned lines are views into the buffer, without the end of line characters.
+    // The buffer is split into lines by batches, so each byte is scanned only once.
+    class LineReader
+    {
+    public:
+        LineReader(std::string_view buffer) : m_buffer(buffer) {}
+
+        bool ReadLine(std::string_view& line)
+        {
+            if (!PeekLine(line))
+                return false;
+            m_lineIndex++;
+            return true;
+        }
+
+        // Gets the next line without consuming it.
+        bool PeekLine(std::string_view& line)
+        {
+            bool hasArrow;
+            return PeekLine(line, hasArrow);
+        }
+
+        bool PeekLine(std::string_view& line, bool& hasArrow)
+        {
+            if (m_lineIndex == m_lineCount && !ScanNextLines())
+                return false;
+            const LineInfo& lineInfo = m_lines[m_lineIndex];
+            line = m_buffer.substr(lineInfo.start, lineInfo.end - lineInfo.start);
+            hasArrow = lineInfo.hasArrow;
+            return true;
+        }
+
+        // Consumes the line returned by the last successful PeekLine.
+        void SkipLine()
+        {
+            m_lineIndex++;
+        }
+
+        // Returns the buffer offset of the next line.
+        size_t GetPosition() const
+        {
+            return m_lineIndex < m_lineCount ? m_lines[m_lineIndex].start : m_scanPosition;
+        }
+
+        // Returns the raw text between two positions of the buffer.
+        std::string_view GetText(size_t start, size_t end) const
+        {
+            return m_buffer.substr(start, end - start);
+        }
+
+#if defined(SRTFILE_STATS)
+        SrtStats& GetStats()
+        {
+            return m_stats;
+        }
+#endif
+
+    private:
+        bool ScanNextLines()
+        {
+            m_lineIndex = 0;
+            m_lineCount = ScanLines(m_buffer, m_scanPosition, m_lines, LineBatchSize);
+            if (m_lineCount == 0)
+                return false;
+            SRTFILE_STAT(m_stats.m_linesRead += m_lineCount);
+            SRTFILE_STAT(m_stats.m_bytesScanned += m_lines[m_lineCount - 1].next - m_scanPosition);
+            m_scanPosition = m_lines[m_lineCount - 1].next;
+            return true;
+        }
+
+        static constexpr size_t LineBatchSize = 256;
+
+        std::string_view m_buffer;
+        size_t m_scanPosition = 0;
+        LineInfo m_lines[LineBatchSize];
+        size_t m_lineIndex = 0;
+        size_t m_lineCount = 0;
+        SRTFILE_STAT(SrtStats m_stats;)
+    };
+
+    // Owns the text that the subtitles refer to when it does not come from the caller's buffer.
+    // Small texts are packed in large blocks, allocated as needed and released all at once.
+    // Stored text never moves, so views into it stay valid until the storage is destroyed.
+    class TextStorage
+    {
+    public:
+        // Returns uninitialized memory for the given number of characters.
+        char* Allocate(size_t size)
+        {
+            if (m_blocks.empty() || m_blockCapacity - m_blockSize < size)
+            {
+                m_blockCapacity = std::max(size, BlockSize);
+                m_blockSize = 0;
+                m_blocks.emplace_back(new char[m_blockCapacity]);
+            }
+            char* text = m_blocks.back().get() + m_blockSize;
+            m_blockSize += size;
+            return text;
+        }
+
+        std::string_view Store(std::string_view text)
+        {
+            if (text.empty())
+                return {};
+            char* storedText = Allocate(text.size());
+            std::memcpy(storedText, text.data(), text.size());
+            return std::string_view(storedText, text.size());
+        }
+
+        // Takes ownership of a whole buffer without copying it.
+        std::string_view Store(std::string&& text)
+        {
+            if (text.empty())
+                return {};
+            return m_buffers.emplace_back(std::move(text));
+        }
+
+        // Releases all stored text, but keeps the last block to store the next texts.
+        void Reset()
+        {
+            if (m_blocks.size() > 1)
+            {
+                std::swap(m_blocks.front(), m_blocks.back());
+                m_blocks.resize(1);
+            }
+            m_blockSize = 0;
+            m_buffers.clear();
+        }
+
+    private:
+        static constexpr size_t BlockSize = 16 * 1024;
+
+        std::vector<std::unique_ptr<char[]>> m_blocks;
+        std::deque<std::string> m_buffers;
+        size_t m_blockSize = 0;
+        size_t m_blockCapacity = 0;
+    };
+
+    // Read-only memory mapping of a whole file, unmapped on destruction.
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept
+        {
+            *this = std::move(other);
+        }
+        MappedFile& operator=(MappedFile&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Close();
+                std::swap(m_data, other.m_data);
+                std::swap(m_size, other.m_size);
+                std::swap(m_writable, other.m_writable);
+            }
+            return *this;
+        }
+        ~MappedFile()
+        {
+            Close();
+        }
+
+        // A writable file is mapped shared, so changes to its text are written to the file.
+        bool Open(const char* path, bool writable = false)
+        {
+            Close();
+#if defined(_WIN32)
+            HANDLE file = ::CreateFileA(path, GENERIC_READ | (writable ? GENERIC_WRITE : 0), FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            return MapFile(file, writable);
+#else
+            int file = ::open(path, writable ? O_RDWR : O_RDONLY);
+            if (file < 0)
+                return false;
+
+            struct stat fileStat;
+            bool success = ::fstat(file, &fileStat) == 0;
+            if (success && fileStat.st_size > 0)
+            {
+                void* data = ::mmap(nullptr, (size_t)fileStat.st_size, PROT_READ | (writable ? PROT_WRITE : 0),
+                    writable ? MAP_SHARED : MAP_PRIVATE, file, 0);
+                success = data != MAP_FAILED;
+                if (success)
+                {
+                    ::madvise(data, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+                    m_data = (char*)data;
+                    m_size = (size_t)fileStat.st_size;
+                    m_writable = writable;
+                }
+            }
+            ::close(file);
+            return success;
+#endif
+        }
+
+#if defined(_WIN32)
+        bool Open(const wchar_t* path, bool writable = false)
+        {
+            Close();
+            HANDLE file = ::CreateFileW(path, GENERIC_READ | (writable ? GENERIC_WRITE : 0), FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            return MapFile(file, writable);
+        }
+#endif
+
+        void Close()
+        {
+            if (m_data)
+            {
+#if defined(_WIN32)
+                ::UnmapViewOfFile(m_data);
+#else
+                ::munmap(m_data, m_size);
+#endif
+            }
+            m_data = nullptr;
+            m_size = 0;
+            m_writable = false;
+        }
+
+        std::string_view GetText() const
+        {
+            return std::string_view(m_data, m_size);
+        }
+
+        // Returns the text of a file opened for writing, or null.
+        char* GetWritableText() const
+        {
+            return m_writable ? m_data : nullptr;
+        }
+
+    private:
+#if defined(_WIN32)
+        bool MapFile(HANDLE file, bool writable)
+        {
+            if (file == INVALID_HANDLE_VALUE)
+                return false;
+
+            LARGE_INTEGER fileSize;
+            bool success = ::GetFileSizeEx(file, &fileSize) != 0;
+            if (success && fileSize.QuadPart > 0)
+            {
+                HANDLE mapping = ::CreateFileMappingW(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+                void* data = mapping ? ::MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0) : nullptr;
+                success = data != nullptr;
+                if (success)
+                {
+                    m_data = (char*)data;
+                    m_size = (size_t)fileSize.QuadPart;
+                    m_writable = writable;
+                }
+                if (mapping)
+                    ::CloseHandle(mapping);
+            }
+            ::CloseHandle(file);
+            return success;
+        }
+#endif
+
+        char* m_data = nullptr;
+        size_t m_size = 0;
+        bool m_writable = false;
+    };
+
+    // Reads the whole stream into the buffer, without seeking.
+    inline void ReadStream(std::istream& stream, std::string& buffer)
+    {
+        size_t size = 0;
+        while (stream.good())
+        {
+            buffer.resize(size + 64 * 1024);
+            stream.read(&buffer[size], (std::streamsize)(buffer.size() - size));
+            size += (size_t)stream.gcount();
+        }
+        buffer.resize(size);
+    }
+
+    // Two-digit strings for 00 to 99, to format numbers two digits at a time.
+    inline const char* GetDigitPairs()
+    {
+        static const char digitPairs[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+        return digitPairs;
+    }
+
+    // Writes the number at the given position, and returns the position after the last digit.
+    // Needs room for 20 characters.
+    inline char* FormatNumber(char* text, long value, int minDigits = 1)
+    {
+        if (value < 0)
+        {
+            *text++ = '-';
+            value = -value;
+        }
+
+        char digits[20];
+        char* digitsEnd = digits + sizeof(digits);
+        char* pos = digitsEnd;
+        const char* digitPairs = GetDigitPairs();
+        while (value >= 100)
+        {
+            const long pair = value % 100;
+            value /= 100;
+            *--pos = digitPairs[pair * 2 + 1];
+            *--pos = digitPairs[pair * 2];
+        }
+        if (value >= 10)
+        {
+            *--pos = digitPairs[value * 2 + 1];
+            *--pos = digitPairs[value * 2];
+        }
+        else
+        {
+            *--pos = (char)('0' + value);
+        }
+        while (digitsEnd - pos < minDigits)
+            *--pos = '0';
+
+        std::memcpy(text, pos, (size_t)(digitsEnd - pos));
+        return text + (digitsEnd - pos);
+    }
+
+    // Writes a timecode in the HH:MM:SS,mmm format, and returns the position after it.
+    // Needs room for 32 characters.
+    inline char* FormatTimeCode(char* text, long milliseconds)
+    {
+        milliseconds = std::max(milliseconds, 0L);
+        const long hours = milliseconds / (60 * 60 * 1000);
+        const long minutes = milliseconds / (60 * 1000) % 60;
+        const long seconds = milliseconds / 1000 % 60;
+        const long ms = milliseconds % 1000;
+
+        const char* digitPairs = GetDigitPairs();
+        if (hours < 100)
+        {
+            *text++ = digitPairs[hours * 2];
+            *text++ = digitPairs[hours * 2 + 1];
+        }
+        else
+        {
+            text = FormatNumber(text, hours);
+        }
+        text[0] = ':';
+        text[1] = digitPairs[minutes * 2];
+        text[2] = digitPairs[minutes * 2 + 1];
+        text[3] = ':';
+        text[4] = digitPairs[seconds * 2];
+        text[5] = digitPairs[seconds * 2 + 1];
+        text[6] = ',';
+        text[7] = (char)('0' + ms / 100);
+        text[8] = digitPairs[ms % 100 * 2];
+        text[9] = digitPairs[ms % 100 * 2 + 1];
+        return text + 10;
+    }
+
+    // Formatting shared by all the outputs SRT text can be written to.
+    // Derived classes provide Append(const char* text, size_t size).
+    template <typename Derived>
+    class OutputFormatter
+    {
+    public:
+        void Append(char c)
+        {
+            Self().Append(&c, 1);
+        }
+
+        void Append(std::string_view text)
+        {
+            Self().Append(text.data(), text.size());
+        }
+
+        void AppendNumber(long value)
+        {
+            char text[24];
+            Self().Append(text, (size_t)(FormatNumber(text, value) - text));
+        }
+
+        void AppendTimeCode(long milliseconds)
+        {
+            char text[32];
+            Self().Append(text, (size_t)(FormatTimeCode(text, milliseconds) - text));
+        }
+
+        // Appends raw text as one or more lines, dropping any carriage return.
+        void AppendLines(std::string_view text)
+        {
+            if (text.empty())
+                return;
+
+            size_t pos = 0;
+            while (pos < text.size())
+            {
+                size_t crPos = std::min(text.find('\r', pos), text.size());
+                Self().Append(text.data() + pos, crPos - pos);
+                pos = crPos + 1;
+            }
+
+            if (text.back() != '\n')
+                Self().Append("\n", 1);
+        }
+
+        // Called between subtitles, for outputs that write in chunks.
+        void FlushIfFull()
+        {
+        }
+
+    private:
+        Derived& Self()
+        {
+            return static_cast<Derived&>(*this);
+        }
+    };
+
+    // Collects output text in one contiguous buffer.
+    // When created for a stream, the text is written to the stream in large chunks.
+    class OutputBuffer : public OutputFormatter<OutputBuffer>
+    {
+    public:
+        using OutputFormatter::Append;
+
+        OutputBuffer() = default;
+        OutputBuffer(std::ostream& stream) : m_stream(&stream)
+        {
+            m_buffer.reserve(FlushSize + FlushSize / 4);
+        }
+        OutputBuffer(const OutputBuffer&) = delete;
+        OutputBuffer& operator=(const OutputBuffer&) = delete;
+        ~OutputBuffer()
+        {
+            Flush();
+        }
+
+        void Append(char c)
+        {
+            m_buffer.push_back(c);
+        }
+
+        void Append(const char* text, size_t size)
+        {
+            m_buffer.append(text, size);
+        }
+
+        // Writes the text to the stream once enough has been collected.
+        void FlushIfFull()
+        {
+            if (m_buffer.size() >= FlushSize)
+                Flush();
+        }
+
+        void Flush()
+        {
+            if (m_stream && !m_buffer.empty())
+            {
+                m_stream->write(m_buffer.data(), (std::streamsize)m_buffer.size());
+                m_flushedSize += m_buffer.size();
+                m_buffer.clear();
+            }
+        }
+
+        // Number of characters appended so far, flushed or not.
+        size_t GetWrittenSize() const
+        {
+            return m_flushedSize + m_buffer.size();
+        }
+
+        // Text collected so far, for buffers not writing to a stream.
+        std::string& GetText()
+        {
+            return m_buffer;
+        }
+
+    private:
+        static constexpr size_t FlushSize = 256 * 1024;
+
+        std::string m_buffer;
+        std::ostream* m_stream = nullptr;
+        size_t m_flushedSize = 0;
+    };
+
+    // Writes output text into memory owned by the caller, without ever going past its end.
+    class FixedOutputBuffer : public OutputFormatter<FixedOutputBuffer>
+    {
+    public:
+        using OutputFormatter::Append;
+
+        FixedOutputBuffer(char* buffer, size_t size) : m_buffer(buffer), m_capacity(size) {}
+
+        void Append(const char* text, size_t size)
+        {
+            if (size > m_capacity - m_size)
+            {
+                m_overflow = true;
+                return;
+            }
+            std::memcpy(m_buffer + m_size, text, size);
+            m_size += size;
+        }
+
+        size_t GetSize() const
+        {
+            return m_size;
+        }
+
+        // The output did not fit, and was cut.
+        bool HasOverflowed() const
+        {
+            return m_overflow;
+        }
+
+    private:
+        char* m_buffer;
+        size_t m_capacity;
+        size_t m_size = 0;
+        bool m_overflow = false;
+    };
+
+    // Counts the size of the output text without writing it.
+    class OutputSizeCounter : public OutputFormatter<OutputSizeCounter>
+    {
+    public:
+        using OutputFormatter::Append;
+
+        void Append(const char*, size_t size)
+        {
+            m_size += size;
+        }
+
+        void AppendLines(std::string_view text)
+        {
+            if (text.empty())
+                return;
+            m_size += text.size() - (size_t)std::count(text.begin(), text.end(), '\r');
+            if (text.back() != '\n')
+                m_size++;
+        }
+
+        size_t GetSize() const
+        {
+            return m_size;
+        }
+
+    private:
+        size_t m_size = 0;
+    };
+
+    inline bool IsBlankLine(std::string_view str)
+    {
+        return str.find_first_not_of(" \t\n\v\f\r") == std::string_view::npos;
+    }
+
+    // Reads a subtitle index, ignoring leading whitespace and trailing characters.
+    // Negative numbers and numbers too large for a long are not indexes: their lines are kept as extra text.
+    inline bool ParseIndex(std::string_view str, long& index)
+    {
+        size_t pos = str.find_first_not_of(" \t\v\f");
+        if (pos == std::string_view::npos)
+            return false;
+
+        bool negative = str[pos] == '-';
+        if (str[pos] == '-' || str[pos] == '+')
+            pos++;
+
+        if (pos >= str.size() || str[pos] < '0' || str[pos] > '9')
+            return false;
+
+        long value = 0;
+        for (; pos < str.size() && str[pos] >= '0' && str[pos] <= '9'; pos++)
+        {
+            const long digit = str[pos] - '0';
+            if (value > (LONG_MAX - digit) / 10)
+                return false;
+            value = value * 10 + digit;
+        }
+
+        if (negative)
+            return false;
+
+        index = value;
+        return true;
+    }
+
+    inline bool IsDigit(char c)
+    {
+        return (unsigned)(c - '0') <= 9u;
+    }
+
+    // Reads a number of at most maxDigits digits.
+    inline bool ScanNumber(const char*& pos, const char* end, int maxDigits, long& value)
+    {
+        const char* start = pos;
+        const char* last = pos + std::min<ptrdiff_t>(maxDigits, end - pos);
+        value = 0;
+        while (pos < last && IsDigit(*pos))
+            value = value * 10 + (*pos++ - '0');
+        return pos != start;
+    }
+
+    inline bool ScanChar(const char*& pos, const char* end, char c)
+    {
+        if (pos >= end || *pos != c)
+            return false;
+        pos++;
+        return true;
+    }
+
+    // Reads a timecode in the HH:MM:SS,mmm format, ignoring leading whitespace.
+    // Fields can have fewer digits, and a period can be used instead of the comma.
+    inline bool ScanTimeCode(const char*& pos, const char* end, long& milliseconds)
+    {
+        while (pos < end && (*pos == ' ' || *pos == '\t'))
+            pos++;
+
+        // Fast path for the standard fixed-width format, without any branch per digit
+        if (end - pos >= 12 && pos[2] == ':' && pos[5] == ':' && (pos[8] == ',' || pos[8] == '.'))
+        {
+            const unsigned h0 = (unsigned)(pos[0] - '0'), h1 = (unsigned)(pos[1] - '0');
+            const unsigned m0 = (unsigned)(pos[3] - '0'), m1 = (unsigned)(pos[4] - '0');
+            const unsigned s0 = (unsigned)(pos[6] - '0'), s1 = (unsigned)(pos[7] - '0');
+            const unsigned ms0 = (unsigned)(pos[9] - '0'), ms1 = (unsigned)(pos[10] - '0'), ms2 = (unsigned)(pos[11] - '0');
+            const bool nonDigit = (h0 > 9u) | (h1 > 9u) | (m0 > 9u) | (m1 > 9u) | (s0 > 9u) | (s1 > 9u) | (ms0 > 9u) | (ms1 > 9u) | (ms2 > 9u);
+            if (!nonDigit)
+            {
+                milliseconds = (long)(((h0 * 10 + h1) * 60 + m0 * 10 + m1) * 60 + s0 * 10 + s1) * 1000L + (long)(ms0 * 100 + ms1 * 10 + ms2);
+                pos += 12;
+                return true;
+            }
+        }
+
+        long hours, minutes, seconds, ms;
+        if (!ScanNumber(pos, end, 2, hours) || !ScanChar(pos, end, ':') ||
+            !ScanNumber(pos, end, 2, minutes) || !ScanChar(pos, end, ':') ||
+            !ScanNumber(pos, end, 2, seconds) || !(ScanChar(pos, end, ',') || ScanChar(pos, end, '.')) ||
+            !ScanNumber(pos, end, 3, ms))
+            return false;
+
+        milliseconds = ((hours * 60 + minutes) * 60 + seconds) * 1000 + ms;
+        return true;
+    }
+
+    // Reads both timecodes of a "start --> end" timing line in a single pass.
+    // timingEnd receives the offset of the text following the end timecode.
+    inline bool ScanTimingLine(std::string_view line, long& startMs, long& endMs, size_t& timingEnd)
+    {
+        const char* pos = line.data();
+        const char* end = pos + line.size();
+        if (!ScanTimeCode(pos, end, startMs))
+            return false;
+
+        size_t arrowPos = line.find("-->", (size_t)(pos - line.data()));
+        if (arrowPos == std::string_view::npos)
+            return false;
+
+        pos = line.data() + arrowPos + 3;
+        if (!ScanTimeCode(pos, end, endMs))
+            return false;
+
+        timingEnd = (size_t)(pos - line.data());
+        return true;
+    }
+
+    // Where the timecodes of a timing line are, when both use the fixed-width HH:MM:SS,mmm format
+    // and their digits can be rewritten in place. Null for other timing lines.
+    struct TimingPosition
+    {
+        const char* m_startTime = nullptr;
+        const char* m_endTime = nullptr;
+    };
+
+    inline bool IsFixedWidthTimeCode(const char* pos, const char* end)
+    {
+        return end - pos >= 12 && IsDigit(pos[0]) && IsDigit(pos[1]) && pos[2] == ':' && IsDigit(pos[3]) && IsDigit(pos[4]) &&
+            pos[5] == ':' && IsDigit(pos[6]) && IsDigit(pos[7]) && (pos[8] == ',' || pos[8] == '.') &&
+            IsDigit(pos[9]) && IsDigit(pos[10]) && IsDigit(pos[11]);
+    }
+
+    // Finds the timecodes on the line following the index line that starts at the given position.
+    inline TimingPosition FindTimingPosition(const char* indexLine, const char* end)
+    {
+        const char* line = (const char*)std::memchr(indexLine, '\n', (size_t)(end - indexLine));
+        if (line == nullptr)
+            return {};
+        line++;
+        const char* newline = (const char*)std::memchr(line, '\n', (size_t)(end - line));
+        const char* lineEnd = newline != nullptr ? newline : end;
+
+        const char* startTime = line;
+        while (startTime < lineEnd && (*startTime == ' ' || *startTime == '\t'))
+            startTime++;
+        if (!IsFixedWidthTimeCode(startTime, lineEnd))
+            return {};
+
+        const std::string_view rest(startTime + 12, (size_t)(lineEnd - startTime - 12));
+        const size_t arrowPos = rest.find("-->");
+        if (arrowPos == std::string_view::npos)
+            return {};
+
+        const char* endTime = rest.data() + arrowPos + 3;
+        while (endTime < lineEnd && (*endTime == ' ' || *endTime == '\t'))
+            endTime++;
+        if (!IsFixedWidthTimeCode(endTime, lineEnd))
+            return {};
+        return { startTime, endTime };
+    }
+
+    // Rewrites the digits of a fixed-width timecode, keeping its separator. The time must be under 100 hours.
+    inline void PatchTimeCode(char* text, long milliseconds)
+    {
+        const char separator = text[8];
+        FormatTimeCode(text, milliseconds);
+        text[8] = separator;
+    }
+
+    // Finds the first safe place to split the buffer after the given position, or npos if none.
+    // A subtitle always starts on an index line that follows a blank line and is followed
+    // by a valid timing line, whatever came before. Only its extra text depends on the previous lines.
+    inline size_t FindCueBoundary(std::string_view buffer, size_t position)
+    {
+        auto NextLine = [&](size_t lineStart, std::string_view& line)
+        {
+            size_t newline = std::min(buffer.find('\n', lineStart), buffer.size());
+            size_t lineEnd = newline;
+            while (lineEnd > lineStart && buffer[lineEnd - 1] == '\r')
+                lineEnd--;
+            line = buffer.substr(lineStart, lineEnd - lineStart);
+            return std::min(newline + 1, buffer.size());
+        };
+
+        size_t lineStart = buffer.find('\n', position);
+        if (lineStart == std::string_view::npos)
+            return std::string_view::npos;
+        lineStart++;
+
+        std::string_view line, indexLine, timingLine;
+        while (lineStart < buffer.size())
+        {
+            const size_t indexStart = NextLine(lineStart, line);
+            if (IsBlankLine(line) && indexStart < buffer.size())
+            {
+                long index, startMs, endMs;
+                size_t timingEnd;
+                const size_t timingStart = NextLine(indexStart, indexLine);
+                if (ParseIndex(indexLine, index) && timingStart < buffer.size())
+                {
+                    NextLine(timingStart, timingLine);
+                    if (timingLine.find("-->") != std::string_view::npos &&
+                        ScanTimingLine(timingLine, startMs, endMs, timingEnd))
+                        return indexStart;
+                }
+            }
+            lineStart = indexStart;
+        }
+        return std::string_view::npos;
+    }
+
+    // Bulk timing kernels, applied to packed arrays of times in milliseconds.
+    // Results are clamped to zero, so subtitles never start before the beginning of the video.
+
+    // Adds the offset to all times, saturating at INT32_MAX.
+    inline void OffsetTimes(int32_t* times, size_t count, int64_t offset)
+    {
+        // Times are first clamped to the range where adding the offset can't overflow
+        const int32_t clampedOffset = (int32_t)std::min<int64_t>(std::max<int64_t>(offset, -INT32_MAX), INT32_MAX);
+        const int32_t minTime = clampedOffset < 0 ? INT32_MIN - clampedOffset : INT32_MIN;
+        const int32_t maxTime = clampedOffset > 0 ? INT32_MAX - clampedOffset : INT32_MAX;
+        size_t i = 0;
+#if defined(SRTFILE_SIMD_AVX2)
+        const __m256i offsets = _mm256_set1_epi32(clampedOffset);
+        const __m256i minTimes = _mm256_set1_epi32(minTime);
+        const __m256i maxTimes = _mm256_set1_epi32(maxTime);
+        const __m256i zeros = _mm256_setzero_si256();
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i values = _mm256_loadu_si256((const __m256i*)(times + i));
+            values = _mm256_min_epi32(_mm256_max_epi32(values, minTimes), maxTimes);
+            values = _mm256_max_epi32(_mm256_add_epi32(values, offsets), zeros);
+            _mm256_storeu_si256((__m256i*)(times + i), values);
+        }
+#endif
+        for (; i < count; i++)
+            times[i] = std::max(std::min(std::max(times[i], minTime), maxTime) + clampedOffset, 0);
+    }
+
+    // Maps one time with time * scale + offset, rounded to the nearest millisecond.
+    inline int32_t RemapTime(int32_t time, double scale, double offset)
+    {
+        const double value = std::nearbyint((double)time * scale + offset);
+        return (int32_t)std::min(std::max(value, 0.0), (double)INT32_MAX);
+    }
+
+    // Maps all times with time * scale + offset, rounded to the nearest millisecond.
+    // Use an offset of zero for a linear scale, ex: 25.0 / 23.976 to convert from 23.976 to 25 fps.
+    inline void RemapTimes(int32_t* times, size_t count, double scale, double offset)
+    {
+        size_t i = 0;
+#if defined(SRTFILE_SIMD_AVX2)
+        const __m256d scales = _mm256_set1_pd(scale);
+        const __m256d offsets = _mm256_set1_pd(offset);
+        const __m256d minValues = _mm256_setzero_pd();
+        const __m256d maxValues = _mm256_set1_pd((double)INT32_MAX);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m256d values = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(times + i)));
+            values = _mm256_add_pd(_mm256_mul_pd(values, scales), offsets);
+            values = _mm256_round_pd(values, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            values = _mm256_min_pd(_mm256_max_pd(values, minValues), maxValues);
+            _mm_storeu_si128((__m128i*)(times + i), _mm256_cvtpd_epi32(values));
+        }
+#endif
+        for (; i < count; i++)
+            times[i] = RemapTime(times[i], scale, offset);
+    }
+
+    // Sets all negative times to zero.
+    inline void ClampTimes(int32_t* times, size_t count)
+    {
+        size_t i = 0;
+#if defined(SRTFILE_SIMD_AVX2)
+        const __m256i zeros = _mm256_setzero_si256();
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i values = _mm256_loadu_si256((const __m256i*)(times + i));
+            _mm256_storeu_si256((__m256i*)(times + i), _mm256_max_epi32(values, zeros));
+        }
+#endif
+        for (; i < count; i++)
+            times[i] = std::max(times[i], 0);
+    }
+
+    // Multiplies one time by the exact fraction numerator / denominator, both below 2^31,
+    // rounded to the nearest millisecond with halves rounded up.
+    inline int32_t ScaleTimeExact(int32_t time, int64_t numerator, int64_t denominator)
+    {
+        if (time <= 0)
+            return 0;
+        const int64_t value = (2 * (int64_t)time * numerator + denominator) / (2 * denominator);
+        return (int32_t)std::min<int64_t>(value, INT32_MAX);
+    }
+
+    // Multiplies all times by the exact fraction numerator / denominator, see ScaleTimeExact.
+    inline void ScaleTimesExact(int32_t* times, size_t count, int64_t numerator, int64_t denominator)
+    {
+        size_t i = 0;
+#if defined(SRTFILE_SIMD_AVX2)
+        // With these limits, time * numerator is exact in a double, and the rounding error of
+        // the division is smaller than the distance of any other quotient to a half
+        if (numerator < (1 << 22) && denominator < (1 << 21))
+        {
+            const __m256d numerators = _mm256_set1_pd((double)numerator);
+            const __m256d denominators = _mm256_set1_pd((double)denominator);
+            const __m256d halves = _mm256_set1_pd(0.5);
+            const __m256d maxValues = _mm256_set1_pd((double)INT32_MAX);
+            const __m128i zeros = _mm_setzero_si128();
+            for (; i + 4 <= count; i += 4)
+            {
+                const __m128i values = _mm_max_epi32(_mm_loadu_si128((const __m128i*)(times + i)), zeros);
+                __m256d results = _mm256_div_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(values), numerators), denominators);
+                results = _mm256_min_pd(_mm256_floor_pd(_mm256_add_pd(results, halves)), maxValues);
+                _mm_storeu_si128((__m128i*)(times + i), _mm256_cvtpd_epi32(results));
+            }
+        }
+#endif
+        for (; i < count; i++)
+            times[i] = ScaleTimeExact(times[i], numerator, denominator);
+    }
+
+    // Sorts values that are usually almost in order already, such as subtitles by start time.
+    // An insertion sort moves the few out of order in linear time, with a full sort when there are too many.
+    template <typename Value>
+    void SortMostlySorted(std::vector<Value>& values)
+    {
+        const size_t count = values.size();
+        size_t moveCount = 0;
+        for (size_t i = 1; i < count && moveCount <= count; i++)
+        {
+            const Value value = values[i];
+            size_t j = i;
+            for (; j > 0 && value < values[j - 1]; j--)
+                values[j] = values[j - 1];
+            values[j] = value;
+            moveCount += i - j;
+        }
+        if (moveCount > count)
+            std::sort(values.begin(), values.end());
+    }
+
+    // Returns the frame whose start is nearest to the time, at a frame rate of frames / seconds.
+    inline int64_t GetNearestFrame(int32_t time, int64_t frames, int64_t seconds)
+    {
+        return (std::max<int64_t>(time, 0) * frames * 2 + 1000 * seconds) / (2000 * seconds);
+    }
+
+    // Returns the start of a frame, rounded to the nearest millisecond.
+    inline int32_t GetFrameTime(int64_t frame, int64_t frames, int64_t seconds)
+    {
+        return (int32_t)std::min<int64_t>((frame * 2000 * seconds + frames) / (2 * frames), INT32_MAX);
+    }
+}
+
+// Replacements of parts of a text, as a list of ranges of the original text and their new text.
+// Edits are kept in order and never overlap, so they can be applied from the last to the first
+// without moving the positions of the others.
+class SrtTextEdits
+{
+public:
+    struct Edit
+    {
+        size_t m_start;
+        size_t m_end;
+        std::string_view m_text;
+    };
+
+    void Clear()
+    {
+        m_edits.clear();
+        m_text.clear();
+    }
+
+    bool IsEmpty() const
+    {
+        return m_edits.empty();
+    }
+
+    size_t GetCount() const
+    {
+        return m_edits.size();
+    }
+
+    Edit GetEdit(size_t edit) const
+    {
+        const StoredEdit& stored = m_edits[edit];
+        return { stored.m_start, stored.m_end, std::string_view(m_text).substr(stored.m_textStart, stored.m_textSize) };
+    }
+
+    // Adds the replacement of the text from start to end, which must follow the previous edits.
+    void Add(size_t start, size_t end, std::string_view text)
+    {
+        const ptrdiff_t sizeChange = m_edits.empty() ? 0 : m_edits.back().m_sizeChange;
+        m_edits.push_back({ start, end, m_text.size(), text.size(), sizeChange + (ptrdiff_t)text.size() - (ptrdiff_t)(end - start) });
+        m_text.append(text);
+    }
+
+    // Difference between the sizes of the edited and original texts.
+    ptrdiff_t GetSizeChange() const
+    {
+        return m_edits.empty() ? 0 : m_edits.back().m_sizeChange;
+    }
+
+    // Returns where a position of the original text is in the edited text.
+    // A position at the start of an edit stays before its new text, one at its end stays after it.
+    size_t MapPosition(size_t position) const
+    {
+        auto it = std::upper_bound(m_edits.begin(), m_edits.end(), position,
+            [](size_t x, const StoredEdit& edit) { return x < edit.m_end; });
+        if (it == m_edits.begin())
+            return position;
+        return (size_t)((ptrdiff_t)position + (it - 1)->m_sizeChange);
+    }
+
+    // Returns a copy of the text with the edits applied.
+    std::string Apply(std::string_view text) const
+    {
+        std::string result;
+        result.reserve((size_t)((ptrdiff_t)text.size() + GetSizeChange()));
+        size_t position = 0;
+        for (size_t edit = 0; edit < m_edits.size(); edit++)
+        {
+            const Edit current = GetEdit(edit);
+            result.append(text.substr(position, current.m_start - position));
+            result.append(current.m_text);
+            position = current.m_end;
+        }
+        result.append(text.substr(position));
+        return result;
+    }
+
+private:
+    struct StoredEdit
+    {
+        size_t m_start;
+        size_t m_end;
+        size_t m_textStart;
+        size_t m_textSize;
+        ptrdiff_t m_sizeChange;     // Total of all the edits up to this one
+    };
+
+    std::vector<StoredEdit> m_edits;
+    std::string m_text;             // New text of all the edits, one after the other
+};
+
+class SrtTimeCode
+{
+public:
+    SrtTimeCode() = default;
+    SrtTimeCode(const char* str)
+    {
+        SetFromString(str);
+    }
+    SrtTimeCode(int hours, int minutes, int seconds, int milliseconds)
+    {
+        Set(hours, minutes, seconds, milliseconds);
+    }
+
+    void Clear()
+    {
+        *this = {};
+    }
+
+    bool IsValid() const
+    {
+        return m_timeCodeMs >= 0L;
+    }
+
+    bool operator<(const SrtTimeCode& other) const
+    {
+        return m_timeCodeMs < other.m_timeCodeMs;
+    }
+
+    void Set(long hours, long minutes, long seconds, long milliseconds)
+    {
+        m_timeCodeMs = milliseconds;
+        m_timeCodeMs += seconds * 1000;
+        m_timeCodeMs += minutes * 60 * 1000;
+        m_timeCodeMs += hours * 60 * 60 * 1000;
+        m_timeCodeMs = std::max(m_timeCodeMs, 0L);
+    }
+
+    void SetMilliseconds(long milliseconds)
+    {
+        m_timeCodeMs = milliseconds;
+    }
+
+    bool SetFromString(std::string_view str)
+    {
+        const char* pos = str.data();
+        long milliseconds;
+        if (!SrtFileInternal::ScanTimeCode(pos, pos + str.size(), milliseconds))
+            return false;
+        m_timeCodeMs = milliseconds;
+        return true;
+    }
+
+    void Get(int& hours, int& minutes, int& seconds, int& milliseconds) const
+    {
+        long remainder = std::max(m_timeCodeMs, 0L);
+        hours = remainder / (60 * 60 * 1000);
+        remainder -= hours * 60 * 60 * 1000;
+        minutes = remainder / (60 * 1000);
+        remainder -= minutes * 60 * 1000;
+        seconds = remainder / 1000;
+        milliseconds = remainder - seconds * 1000;
+    }
+
+    long GetMilliseconds() const
+    {
+        return m_timeCodeMs;
+    }
+
+    void WriteToString(std::string& str) const
+    {
+        char textBuffer[32];
+        str.assign(textBuffer, SrtFileInternal::FormatTimeCode(textBuffer, m_timeCodeMs));
+    }
+
+    void OffsetInMilliseconds(long offset)
+    {
+        m_timeCodeMs = std::max(m_timeCodeMs + offset, 0L);
+    }
+
+private:
+    long m_timeCodeMs = -1;
+};
+
+class SrtSubtitle
+{
+public:
+    SrtSubtitle() = default;
+
+    void Clear()
+    {
+        *this = {};
+    }
+
+    bool IsValid() const
+    {
+        return m_index >= 0L && m_startTime.IsValid() && m_endTime.IsValid();
+    }
+
+    // Reads the next subtitle from the given line reader.
+    // The text members are views into the reader's buffer.
+    // Lines preceding the subtitle that are not part of the SRT standard are kept in m_extra.
+    //
+    // Lines are read forward only, as a state machine looking one line ahead:
+    // - Index: any line with a number can be the index of the subtitle.
+    // - Timing: the line following the index must have valid timecodes, or it can be a new index.
+    // - Text: all lines up to the next blank line, which is left for the next subtitle.
+    bool ReadFromBuffer(SrtFileInternal::LineReader& reader)
+    {
+        enum class State { Index, Timing, Text };
+        State state = State::Index;
+
+        const size_t extraStart = reader.GetPosition();
+        size_t indexLineStart = extraStart;
+        std::string_view line;
+        bool hasArrow = false;
+        bool fixedEndTime = false;
+
+        while (reader.PeekLine(line, hasArrow))
+        {
+            switch (state)
+            {
+                case State::Text:
+                    if (SrtFileInternal::IsBlankLine(line))
+                        return IsValid();
+                    SRTFILE_STAT(reader.GetStats().m_subtitleLines++);
+                    if (m_text.empty())
+                        m_text = line;
+                    else
+                        m_text = std::string_view(m_text.data(), (size_t)(line.data() + line.size() - m_text.data()));
+                    break;
+
+                case State::Timing:
+                    if (hasArrow && ReadTimingLine(line, fixedEndTime))
+                    {
+                        // Everything before the index line is extra text
+                        m_extra = reader.GetText(extraStart, indexLineStart);
+                        state = State::Text;
+                        SRTFILE_STAT(reader.GetStats().m_subtitleLines += 2);
+                        SRTFILE_STAT(reader.GetStats().m_endTimeFixups += fixedEndTime);
+                        break;
+                    }
+                    SRTFILE_STAT(reader.GetStats().m_timingFailures += hasArrow);
+                    [[fallthrough]];
+
+                case State::Index:
+                    state = SrtFileInternal::ParseIndex(line, m_index) ? State::Timing : State::Index;
+                    indexLineStart = reader.GetPosition();
+                    break;
+            }
+            reader.SkipLine();
+        }
+
+        if (state == State::Text)
+            return IsValid();
+
+        // No subtitle found, keep the remaining text as extra
+        m_index = -1;
+        m_extra = reader.GetText(extraStart, reader.GetPosition());
+        return false;
+    }
+
+    void WriteToFile(std::ostream& stream, bool ignoreExtra) const
+    {
+        if (!stream.good())
+            return;
+
+        SrtFileInternal::OutputBuffer output(stream);
+        WriteToOutput(output, ignoreExtra);
+    }
+
+    // Writes the subtitle to any of the SrtFileInternal outputs.
+    template <typename Output>
+    void WriteToOutput(Output& output, bool ignoreExtra) const
+    {
+        if (!IsValid())
+            return;
+
+        if (!ignoreExtra)
+        {
+            output.AppendLines(m_extra);
+        }
+
+        output.AppendNumber(m_index);
+        output.Append('\n');
+
+        output.AppendTimeCode(m_startTime.GetMilliseconds());
+        output.Append(" --> ");
+        output.AppendTimeCode(m_endTime.GetMilliseconds());
+        if (!m_coordinates.empty())
+        {
+            output.Append(' ');
+            output.Append(m_coordinates);
+        }
+        output.Append('\n');
+
+        output.AppendLines(m_text);
+    }
+
+    // Adds the edits that replace the index and timecodes found in the buffer at the given position
+    // when they differ from the subtitle's. The index line is replaced whole, the timing line up to the coordinates.
+    // With standardLines, index and timing lines that aren't in the standard form are rewritten as well.
+    bool WriteEdits(std::string_view buffer, size_t indexLineStart, SrtTextEdits& edits, bool standardLines = false) const
+    {
+        auto GetLine = [buffer](size_t lineStart)
+        {
+            size_t lineEnd = std::min(buffer.find('\n', lineStart), buffer.size());
+            const size_t nextLine = std::min(lineEnd + 1, buffer.size());
+            while (lineEnd > lineStart && buffer[lineEnd - 1] == '\r')
+                lineEnd--;
+            return std::make_pair(buffer.substr(lineStart, lineEnd - lineStart), nextLine);
+        };
+
+        const auto [indexLine, timingLineStart] = GetLine(indexLineStart);
+        const std::string_view timingLine = GetLine(timingLineStart).first;
+        long index, startMs, endMs;
+        size_t timingEnd;
+        if (!SrtFileInternal::ParseIndex(indexLine, index) || !SrtFileInternal::ScanTimingLine(timingLine, startMs, endMs, timingEnd))
+            return false;
+
+        // The whole index line is replaced: the parser ignores any text after the number, and keeping
+        // it could turn the line into a timing line once the number is shorter.
+        char text[80];
+        const std::string_view number(text, (size_t)(SrtFileInternal::FormatNumber(text, m_index) - text));
+        if (index != m_index || (standardLines && indexLine != number))
+            edits.Add(indexLineStart, indexLineStart + indexLine.size(), number);
+
+        // The parser moves an end time before the start time just after it
+        if (endMs < startMs)
+            endMs = startMs + 1;
+        char* pos = SrtFileInternal::FormatTimeCode(text, m_startTime.GetMilliseconds());
+        std::memcpy(pos, " --> ", 5);
+        pos = SrtFileInternal::FormatTimeCode(pos + 5, m_endTime.GetMilliseconds());
+        const std::string_view timeCodes(text, (size_t)(pos - text));
+
+        if (standardLines)
+        {
+            // The coordinates are kept, only the text around them is rewritten. The space after them
+            // stays when they end with a carriage return, which would otherwise end the line.
+            const size_t coordinatesStart = std::min(timingLine.find_first_not_of(" \t", timingEnd), timingLine.size());
+            const size_t coordinatesEnd = coordinatesStart < timingLine.size() ? timingLine.find_last_not_of(" \t") + 1 : coordinatesStart;
+            std::string prefix(timeCodes);
+            if (coordinatesStart < coordinatesEnd)
+                prefix += ' ';
+            if (timingLine.substr(0, coordinatesStart) != prefix)
+                edits.Add(timingLineStart, timingLineStart + coordinatesStart, prefix);
+            if (coordinatesEnd < timingLine.size() && timingLine[coordinatesEnd - 1] != '\r')
+                edits.Add(timingLineStart + coordinatesEnd, timingLineStart + timingLine.size(), {});
+        }
+        else if (startMs != m_startTime.GetMilliseconds() || endMs != m_endTime.GetMilliseconds())
+        {
+            const size_t timingStart = timingLine.find_first_not_of(" \t");
+            edits.Add(timingLineStart + timingStart, timingLineStart + timingEnd, timeCodes);
+        }
+        return true;
+    }
+
+    // Splits the text into lines, without the end of line characters.
+    std::vector<std::string_view> GetTextLines() const
+    {
+        std::vector<std::string_view> textLines;
+        SrtFileInternal::LineReader reader(m_text);
+        std::string_view textLine;
+        while (reader.ReadLine(textLine))
+            textLines.push_back(textLine);
+        return textLines;
+    }
+
+    void OffsetInMilliseconds(long offset)
+    {
+        m_startTime.OffsetInMilliseconds(offset);
+        m_endTime.OffsetInMilliseconds(offset);
+    }
+
+    void SetIndex(long index)
+    {
+        m_index = index;
+    }
+
+private:
+    // Reads the "start --> end" timecodes and the optional coordinates that follow.
+    // Sets fixedEndTime when the end time was before the start time.
+    bool ReadTimingLine(std::string_view line, bool& fixedEndTime)
+    {
+        long startMs, endMs;
+        size_t timingEnd;
+        if (!SrtFileInternal::ScanTimingLine(line, startMs, endMs, timingEnd))
+            return false;
+
+        m_startTime.SetMilliseconds(startMs);
+        m_endTime.SetMilliseconds(endMs);
+        fixedEndTime = m_endTime < m_startTime;
+        if (fixedEndTime)
+        {
+            m_endTime.SetMilliseconds(m_startTime.GetMilliseconds() + 1);
+        }
+
+        size_t coordinatesStart = line.find_first_not_of(" \t", timingEnd);
+        if (coordinatesStart != std::string_view::npos)
+        {
+            m_coordinates = line.substr(coordinatesStart, line.find_last_not_of(" \t") + 1 - coordinatesStart);
+        }
+        return true;
+    }
+
+public:
+    // The text members are views into the buffer the subtitle was read from.
+    // To change them, store the new text in the file with SrtFile::SetText and the other setters.
+    long m_index = -1;
+    SrtTimeCode m_startTime;
+    SrtTimeCode m_endTime;
+    std::string_view m_coordinates;
+    std::string_view m_text;    // All text lines, as found in the file
+    std::string_view m_extra;
+};
+
+// Subtitles sorted by start time, to find the ones shown at a time or during a range of times
+// in O(log n + k). The sorted subtitles are the nodes of an implicit binary tree, in order,
+// where each node keeps the latest end time of its subtree. Subtitles starting at the same
+// time stay in file order.
+class SrtTimeIndex
+{
+public:
+    void Clear()
+    {
+        *this = {};
+    }
+
+    bool IsBuilt() const
+    {
+        return m_built;
+    }
+
+    void Invalidate()
+    {
+        m_built = false;
+    }
+
+    void Build(const std::vector<SrtSubtitle>& subtitles)
+    {
+        const size_t count = subtitles.size();
+        m_order.resize(count);
+        for (size_t i = 0; i < count; i++)
+            m_order[i] = i;
+
+        // Files are almost always sorted already
+        auto GetStart = [&subtitles](size_t subtitle) { return subtitles[subtitle].m_startTime.GetMilliseconds(); };
+        bool sorted = true;
+        for (size_t i = 1; i < count && sorted; i++)
+            sorted = GetStart(i - 1) <= GetStart(i);
+        if (!sorted)
+        {
+            // The positions keep subtitles starting at the same time in file order
+            std::vector<std::pair<long, size_t>> starts(count);
+            for (size_t i = 0; i < count; i++)
+                starts[i] = { GetStart(i), i };
+            SrtFileInternal::SortMostlySorted(starts);
+            for (size_t i = 0; i < count; i++)
+                m_order[i] = starts[i].second;
+        }
+
+        m_nodes.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            const SrtSubtitle& subtitle = subtitles[m_order[i]];
+            m_nodes[i].m_start = ToTime(subtitle.m_startTime.GetMilliseconds());
+            m_nodes[i].m_end = ToTime(subtitle.m_endTime.GetMilliseconds());
+        }
+
+        // The root is the node of the highest level within the subtitles
+        m_rootLevel = 0;
+        while (((size_t)2 << m_rootLevel) <= count)
+            m_rootLevel++;
+        if (count > 0)
+            ComputeMaxEnd(GetRoot(), m_rootLevel);
+        m_built = true;
+    }
+
+    // Calls function(subtitle) with the position of each subtitle shown at the given time,
+    // starting at or before it and ending after it, in order of start time.
+    template <typename Function>
+    void ForEachAt(long time, Function function) const
+    {
+        ForEachBetween(time, (long long)time + 1, function);
+    }
+
+    // Calls function(subtitle) with the position of each subtitle starting before the end
+    // and ending after the start of the given range, in order of start time.
+    template <typename Function>
+    void ForEachBetween(long long start, long long end, Function function) const
+    {
+        if (!m_nodes.empty() && start < end)
+            Visit(GetRoot(), m_rootLevel, start, end, function);
+    }
+
+private:
+    static int32_t ToTime(long milliseconds)
+    {
+        return (int32_t)std::min<long long>(std::max<long long>(milliseconds, INT32_MIN), INT32_MAX);
+    }
+
+    size_t GetRoot() const
+    {
+        return ((size_t)1 << m_rootLevel) - 1;
+    }
+
+    // A node of level k has k children levels below it, and its subtree covers the
+    // positions up to 2^k - 1 before and after it. Leaves are at even positions.
+    // Nodes past the last subtitle only have a left subtree to look into.
+    int32_t ComputeMaxEnd(size_t node, unsigned level)
+    {
+        const size_t count = m_nodes.size();
+        if (node - (((size_t)1 << level) - 1) >= count)
+            return INT32_MIN;
+        if (level == 0)
+            return m_nodes[node].m_maxEnd = m_nodes[node].m_end;
+
+        const size_t half = (size_t)1 << (level - 1);
+        int32_t maxEnd = ComputeMaxEnd(node - half, level - 1);
+        if (node < count)
+        {
+            maxEnd = std::max({ maxEnd, m_nodes[node].m_end, ComputeMaxEnd(node + half, level - 1) });
+            m_nodes[node].m_maxEnd = maxEnd;
+        }
+        return maxEnd;
+    }
+
+    template <typename Function>
+    void Visit(size_t node, unsigned level, long long start, long long end, Function& function) const
+    {
+        // Skip subtrees past the last subtitle, starting too late, or ending too early
+        const size_t count = m_nodes.size();
+        const size_t first = node - (((size_t)1 << level) - 1);
+        if (first >= count || m_nodes[first].m_start >= end || (node < count && m_nodes[node].m_maxEnd <= start))
+            return;
+
+        // Small subtrees are faster to scan
+        if (level <= LinearScanLevel)
+        {
+            const size_t last = std::min(node + ((size_t)1 << level) - 1, count - 1);
+            for (size_t i = first; i <= last && m_nodes[i].m_start < end; i++)
+            {
+                if (m_nodes[i].m_end > start)
+                    function(m_order[i]);
+            }
+            return;
+        }
+
+        const size_t half = (size_t)1 << (level - 1);
+        Visit(node - half, level - 1, start, end, function);
+        if (node < count && m_nodes[node].m_start < end)
+        {
+            if (m_nodes[node].m_end > start)
+                function(m_order[node]);
+            Visit(node + half, level - 1, start, end, function);
+        }
+    }
+
+    struct Node
+    {
+        int32_t m_start;
+        int32_t m_end;
+        int32_t m_maxEnd;               // Latest end time of the subtree
+    };
+
+    static constexpr unsigned LinearScanLevel = 3;
+
+    std::vector<Node> m_nodes;          // Subtitle times in order of start time
+    std::vector<size_t> m_order;        // Positions of the subtitles in the file, in the same order
+    unsigned m_rootLevel = 0;
+    bool m_built = false;
+};
+
+// Consecutive subtitles of a file, from m_first to m_end excluded.
+struct SrtSubtitleRange
+{
+    size_t m_first = 0;
+    size_t m_end = 0;
+
+    size_t GetCount() const
+    {
+        return m_end > m_first ? m_end - m_first : 0;
+    }
+};
+
+// A time of the subtitles and the time it must be moved to, ex: the same line heard at
+// 00:10:00,000 in the original video and at 00:09:31,500 in the new one.
+struct SrtResyncAnchor
+{
+    long m_sourceTime;
+    long m_targetTime;
+};
+
+// Maps times through the line joining each pair of consecutive anchors, sorted by source time,
+// so a file can follow a video that drifts, or had parts cut out. Times before the first or after
+// the last anchor follow the nearest segment, and a single anchor is a constant offset.
+// Times are rounded to the nearest millisecond and clamped to zero, as with SrtFile::RemapTimes.
+class SrtResyncMap
+{
+public:
+    SrtResyncMap() = default;
+    SrtResyncMap(std::vector<SrtResyncAnchor> anchors)
+    {
+        SetAnchors(std::move(anchors));
+    }
+
+    // Anchors with the same source time as an earlier one are ignored.
+    void SetAnchors(std::vector<SrtResyncAnchor> anchors)
+    {
+        std::stable_sort(anchors.begin(), anchors.end(),
+            [](const SrtResyncAnchor& a, const SrtResyncAnchor& b) { return a.m_sourceTime < b.m_sourceTime; });
+        anchors.erase(std::unique(anchors.begin(), anchors.end(),
+            [](const SrtResyncAnchor& a, const SrtResyncAnchor& b) { return a.m_sourceTime == b.m_sourceTime; }), anchors.end());
+
+        m_segments.clear();
+        if (anchors.size() == 1)
+            m_segments.push_back({ LONG_MIN, 1.0, (double)anchors[0].m_targetTime - (double)anchors[0].m_sourceTime });
+        for (size_t i = 0; i + 1 < anchors.size(); i++)
+        {
+            const SrtResyncAnchor& from = anchors[i];
+            const SrtResyncAnchor& to = anchors[i + 1];
+            const double scale = ((double)to.m_targetTime - (double)from.m_targetTime) / ((double)to.m_sourceTime - (double)from.m_sourceTime);
+            m_segments.push_back({ i == 0 ? LONG_MIN : from.m_sourceTime, scale, (double)from.m_targetTime - (double)from.m_sourceTime * scale });
+        }
+    }
+
+    bool IsEmpty() const
+    {
+        return m_segments.empty();
+    }
+
+    // Maps one time. The segment is where the search starts, and is set to the segment of the time,
+    // so mapping times in increasing order with the same segment variable goes through the anchors once.
+    long MapTime(long time, size_t& segment) const
+    {
+        if (m_segments.empty())
+            return time;
+        FindSegment(time, segment);
+        const Segment& found = m_segments[segment];
+        return SrtFileInternal::RemapTime((int32_t)time, found.m_scale, found.m_offset);
+    }
+
+    // Maps all times. Runs of times in the same segment go through the bulk kernel.
+    void MapTimes(int32_t* times, size_t count) const
+    {
+        if (m_segments.empty())
+            return;
+
+        size_t segment = 0;
+        size_t i = 0;
+        while (i < count)
+        {
+            FindSegment(times[i], segment);
+            const long segmentEnd = segment + 1 < m_segments.size() ? m_segments[segment + 1].m_start : LONG_MAX;
+            const long segmentStart = m_segments[segment].m_start;
+            size_t end = i + 1;
+            while (end < count && times[end] >= segmentStart && times[end] < segmentEnd)
+                end++;
+            SrtFileInternal::RemapTimes(times + i, end - i, m_segments[segment].m_scale, m_segments[segment].m_offset);
+            i = end;
+        }
+    }
+
+private:
+    struct Segment
+    {
+        long m_start;       // Source time where the segment starts, the first one starts at LONG_MIN
+        double m_scale;
+        double m_offset;
+    };
+
+    // Moves forward from the given segment, or searches again for a time before it.
+    void FindSegment(long time, size_t& segment) const
+    {
+        if (segment >= m_segments.size() || time < m_segments[segment].m_start)
+        {
+            auto it = std::upper_bound(m_segments.begin(), m_segments.end(), time,
+                [](long value, const Segment& s) { return value < s.m_start; });
+            segment = (size_t)(it - m_segments.begin()) - 1;
+            return;
+        }
+        while (segment + 1 < m_segments.size() && time >= m_segments[segment + 1].m_start)
+            segment++;
+    }
+
+    std::vector<Segment> m_segments;
+};
+
+// Frame rate as an exact fraction of frames per second, ex: 24000/1001 for 23.976 fps.
+struct SrtFrameRate
+{
+    int64_t m_frames = 0;
+    int64_t m_seconds = 1;
+
+    bool IsValid() const
+    {
+        return m_frames > 0 && m_seconds > 0 && m_frames <= MaxValue && m_seconds <= MaxValue;
+    }
+
+    // Reads a fraction such as "24000/1001", or a number of frames per second. The usual
+    // NTSC rates written as decimals, such as 23.976 or 29.97, are read as N * 1000 / 1001.
+    // Returns an invalid rate when the text is not a frame rate.
+    static SrtFrameRate Parse(std::string_view text)
+    {
+        SrtFrameRate rate;
+        const size_t slash = text.find('/');
+        if (slash != std::string_view::npos)
+        {
+            if (!ParseInteger(text.substr(0, slash), rate.m_frames) || !ParseInteger(text.substr(slash + 1), rate.m_seconds))
+                return {};
+            return rate.IsValid() ? rate : SrtFrameRate{};
+        }
+
+        // Decimals are read exactly, ex: 12.5 as 125/10
+        const size_t point = text.find('.');
+        const std::string_view decimals = point == std::string_view::npos ? std::string_view() : text.substr(point + 1);
+        if (decimals.size() > 6 || !ParseInteger(text.substr(0, point), rate.m_frames) ||
+            (point != std::string_view::npos && !ParseInteger(decimals, rate.m_seconds)))
+            return {};
+        const int64_t fraction = rate.m_seconds;
+        rate.m_seconds = 1;
+        for (size_t i = 0; i < decimals.size(); i++)
+            rate.m_seconds *= 10;
+        rate.m_frames = decimals.empty() ? rate.m_frames : rate.m_frames * rate.m_seconds + fraction;
+
+        // An NTSC rate is within 0.005 of N * 1000 / 1001, with N a multiple of 6 such as 24, 30 or 60
+        const int64_t ntscFrames = (rate.m_frames * 1001 + rate.m_seconds * 500) / (rate.m_seconds * 1000);
+        if (!decimals.empty() && ntscFrames % 6 == 0 && ntscFrames > 0 &&
+            std::abs(rate.m_frames * 1001 * 200 - ntscFrames * 1000 * 200 * rate.m_seconds) <= 1001 * rate.m_seconds)
+            return { ntscFrames * 1000, 1001 };
+        return rate.IsValid() ? rate : SrtFrameRate{};
+    }
+
+private:
+    static constexpr int64_t MaxValue = 1000000;
+
+    static bool ParseInteger(std::string_view text, int64_t& value)
+    {
+        if (text.empty() || text.size() > 7)
+            return false;
+        value = 0;
+        for (char c : text)
+        {
+            if (c < '0' || c > '9')
+                return false;
+            value = value * 10 + (c - '0');
+        }
+        return true;
+    }
+};
+
+// Converts the times of subtitles from a video at one frame rate to the same frames at another frame rate,
+// ex: from 23.976 to 25 fps when a film is sped up for PAL, which multiplies all times by 960/1001.
+// Times are multiplied by the exact ratio of the rates, and can also be moved to the nearest frame of the
+// target rate, keeping subtitles at least one frame long.
+class SrtFrameRateConversion
+{
+public:
+    SrtFrameRateConversion() = default;
+    SrtFrameRateConversion(SrtFrameRate from, SrtFrameRate to, bool snapToFrames = false)
+    {
+        if (!from.IsValid() || !to.IsValid())
+            return;
+
+        // Ratios too large to be exact in 64 bits are not supported
+        int64_t numerator = from.m_frames * to.m_seconds;
+        int64_t denominator = from.m_seconds * to.m_frames;
+        const int64_t divisor = std::gcd(numerator, denominator);
+        numerator /= divisor;
+        denominator /= divisor;
+        if (numerator > INT32_MAX || denominator > INT32_MAX)
+            return;
+
+        m_numerator = numerator;
+        m_denominator = denominator;
+        m_target = to;
+        m_snapToFrames = snapToFrames;
+    }
+
+    bool IsEmpty() const
+    {
+        return m_denominator == 0;
+    }
+
+    void Convert(SrtSubtitle& subtitle) const
+    {
+        if (IsEmpty())
+            return;
+
+        int32_t startTime = (int32_t)subtitle.m_startTime.GetMilliseconds();
+        int32_t endTime = (int32_t)subtitle.m_endTime.GetMilliseconds();
+        ConvertTimes(&startTime, &endTime, 1);
+        subtitle.m_startTime.SetMilliseconds(startTime);
+        subtitle.m_endTime.SetMilliseconds(endTime);
+    }
+
+    // Converts the times of subtitles stored as separate arrays, with the bulk kernel.
+    void ConvertTimes(int32_t* startTimes, int32_t* endTimes, size_t count) const
+    {
+        if (IsEmpty())
+            return;
+
+        SrtFileInternal::ScaleTimesExact(startTimes, count, m_numerator, m_denominator);
+        SrtFileInternal::ScaleTimesExact(endTimes, count, m_numerator, m_denominator);
+        if (!m_snapToFrames)
+            return;
+
+        const int64_t frames = m_target.m_frames;
+        const int64_t seconds = m_target.m_seconds;
+        for (size_t i = 0; i < count; i++)
+        {
+            const int64_t startFrame = SrtFileInternal::GetNearestFrame(startTimes[i], frames, seconds);
+            const int64_t endFrame = std::max(SrtFileInternal::GetNearestFrame(endTimes[i], frames, seconds), startFrame + 1);
+            startTimes[i] = SrtFileInternal::GetFrameTime(startFrame, frames, seconds);
+            endTimes[i] = SrtFileInternal::GetFrameTime(endFrame, frames, seconds);
+        }
+    }
+
+private:
+    int64_t m_numerator = 0;
+    int64_t m_denominator = 0;
+    SrtFrameRate m_target;
+    bool m_snapToFrames = false;
+};
+
+// How SrtFile::RepairTimings fixes a subtitle that overlaps the previous one, or starts too soon after it.
+enum class SrtOverlapPolicy
+{
+    TrimPrevious,   // The previous subtitle ends earlier
+    PushNext,       // The subtitle starts later, and keeps its duration
+    Merge,          // The subtitle is removed, and its text is added to the previous one
+};
+
+class SrtFile
+{
+public:
+    SrtFile() = default;
+    SrtFile(std::istream& stream)
+    {
+        ReadFromFile(stream);
+    }
+    SrtFile(std::string_view buffer)
+    {
+        ReadFromBuffer(buffer);
+    }
+    SrtFile(const char* buffer) : SrtFile(std::string_view(buffer)) {}
+
+    // The subtitles refer to the text of the buffer, so a temporary string is kept by the file.
+    SrtFile(std::string&& buffer)
+    {
+        ReadFromBuffer(m_storage.Store(std::move(buffer)));
+    }
+
+    // The subtitles refer to text owned by the file, so it can be moved but not copied.
+    SrtFile(const SrtFile&) = delete;
+    SrtFile& operator=(const SrtFile&) = delete;
+    SrtFile(SrtFile&&) = default;
+    SrtFile& operator=(SrtFile&&) = default;
+
+    void Clear()
+    {
+        *this = {};
+    }
+
+    // Empties the file like Clear, but keeps its memory to read the next file with fewer allocations.
+    void Reset()
+    {
+        m_subtitles.clear();
+        m_timings.clear();
+        m_timeIndex.Invalidate();
+        m_extra = {};
+        m_storage.Reset();
+        m_mappedFile.Close();
+        m_stats = {};
+    }
+
+    bool IsValid() const
+    {
+        return !m_subtitles.empty();
+    }
+
+    // Counters of all reads since the file was cleared or reset.
+    // The writers add theirs to the stats passed to them instead.
+    // They stay at zero unless SRTFILE_STATS is defined.
+    const SrtStats& GetStats() const
+    {
+        return m_stats;
+    }
+
+    void ResetStats()
+    {
+        m_stats = {};
+    }
+
+    // Records where the timecodes of each subtitle are in the text while reading, so that
+    // timing changes can be written back by patching the text in place, see PatchTimings.
+    // The setting is kept when the file is reset.
+    void SetRecordTimings(bool recordTimings)
+    {
+        m_recordTimings = recordTimings;
+    }
+
+    // Reads an SRT file from the given stream.
+    // Can use a std::fstream or a std::stringstream. The stream is only read forwards,
+    // so it can also be a pipe such as std::cin.
+    // Large files can be parsed on several threads, with 0 using all hardware threads.
+    bool ReadFromFile(std::istream& stream, unsigned threadCount = 1)
+    {
+        if (!stream.good())
+            return false;
+
+        std::string buffer;
+        {
+            SRTFILE_STAT(SrtFileInternal::ScopedTimer timer(m_stats.m_readSeconds));
+            SrtFileInternal::ReadStream(stream, buffer);
+        }
+        return ReadFromBuffer(m_storage.Store(std::move(buffer)), threadCount);
+    }
+
+    // Replaces the contents with the SRT file at the given path, mapped in memory.
+    // The subtitles refer directly to the mapped file, which stays mapped until
+    // the SrtFile is cleared or destroyed. The file must not be modified meanwhile.
+    // A writable file can have its timings patched in place with PatchMappedTimings.
+    bool LoadMapped(const char* path, unsigned threadCount = 1, bool writable = false)
+    {
+        Reset();
+        {
+            SRTFILE_STAT(SrtFileInternal::ScopedTimer timer(m_stats.m_readSeconds));
+            if (!m_mappedFile.Open(path, writable))
+                return false;
+        }
+        return ReadFromBuffer(m_mappedFile.GetText(), threadCount);
+    }
+
+#if defined(_WIN32)
+    bool LoadMapped(const wchar_t* path, unsigned threadCount = 1, bool writable = false)
+    {
+        Reset();
+        {
+            SRTFILE_STAT(SrtFileInternal::ScopedTimer timer(m_stats.m_readSeconds));
+            if (!m_mappedFile.Open(path, writable))
+                return false;
+        }
+        return ReadFromBuffer(m_mappedFile.GetText(), threadCount);
+    }
+#endif
+
+    // Reads an SRT file from a buffer already in memory, without copying its text.
+    // The buffer must stay alive and unchanged as long as the subtitles are used.
+    // Large buffers can be split in chunks parsed on several threads, with 0 using all hardware threads.
+    // The result is the same as when parsing on a single thread.
+    bool ReadFromBuffer(std::string_view buffer, unsigned threadCount = 1)
+    {
+        SRTFILE_STAT(SrtFileInternal::ScopedTimer timer(m_stats.m_parseSeconds));
+        m_timeIndex.Invalidate();
+#if !defined(SRTFILE_NO_THREADS)
+        if (threadCount == 0)
+            threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        const size_t chunkCount = std::min<size_t>(threadCount, buffer.size() / MinChunkSize);
+        if (chunkCount > 1)
+            return ReadChunks(buffer, chunkCount);
+#else
+        (void)threadCount;
+#endif
+
+        std::string_view trailingExtra = ReadChunk(buffer, m_subtitles, GetTimings(), m_stats);
+        if (!trailingExtra.empty())
+            m_extra = trailingExtra;
+
+        return IsValid();
+    }
+
+    // Writes SRT file contents to the given stream.
+    // Can use a std::fstream or a std::stringstream. 
+    // The writers add their counters to stats, when given.
+    void WriteToFile(std::ostream& stream, bool ignoreExtra = false, SrtStats* stats = nullptr) const
+    {
+        if (!IsValid() || !stream.good())
+            return;
+
+        SrtStats writeStats;
+        {
+            SRTFILE_STAT(SrtFileInternal::ScopedTimer timer(writeStats.m_writeSeconds));
+            SrtFileInternal::OutputBuffer output(stream);
+            WriteToOutput(output, ignoreExtra);
+            output.Flush();
+            SRTFILE_STAT(writeStats.m_bytesWritten += output.GetWrittenSize());
+        }
+        if (stats != nullptr)
+            stats->Add(writeStats);
+    }
+
+    // Writes SRT file contents to the given string.
+    void WriteToString(std::string& text, bool ignoreExtra = false, SrtStats* stats = nullptr) const
     {
-        char buffer[1024];
-        if (stream.good())
+        SrtStats writeStats;
         {
-            stream.getline(buffer, sizeof(buffer));
-            str = buffer;
-            str.erase(std::remove(str.begin(), str.end(), '\r'), str.end());
-            return true;
+            SRTFILE_STAT(SrtFileInternal::ScopedTimer timer(writeStats.m_writeSeconds));
+            SrtFileInternal::OutputBuffer output;
+            WriteToOutput(output, ignoreExtra);
+            text = std::move(output.GetText());
+            SRTFILE_STAT(writeStats.m_bytesWritten += text.size());
         }
-        return false;
+        if (stats != nullptr)
+            stats->Add(writeStats);
+    }
+
+    // Returns the exact number of characters WriteToBuffer will write.
+    size_t ComputeSerializedSize(bool ignoreExtra = false) const
+    {
+        SrtFileInternal::OutputSizeCounter output;
+        WriteToOutput(output, ignoreExtra);
+        return output.GetSize();
     }
 
-    void WriteLine(std::ostream& stream, const char* format, ...)
+    // Writes SRT file contents to memory owned by the caller, in a single pass.
+    // Use ComputeSerializedSize to allocate the buffer. No null terminator is added.
+    // Returns the number of characters written, or 0 if the buffer is too small.
+    size_t WriteToBuffer(char* buffer, size_t size, bool ignoreExtra = false, SrtStats* stats = nullptr) const
     {
-        char buffer[1024];
-        va_list argptr;
-        va_start(argptr, format);
-        int len = vsnprintf(buffer, sizeof(buffer), format, argptr);
-        va_end(argptr);
+        SrtStats writeStats;
+        size_t writtenSize = 0;
+        {
+            SRTFILE_STAT(SrtFileInternal::ScopedTimer timer(writeStats.m_writeSeconds));
+            SrtFileInternal::FixedOutputBuffer output(buffer, size);
+            WriteToOutput(output, ignoreExtra);
+            writtenSize = output.HasOverflowed() ? 0 : output.GetSize();
+            SRTFILE_STAT(writeStats.m_bytesWritten += writtenSize);
+        }
+        if (stats != nullptr)
+            stats->Add(writeStats);
+        return writtenSize;
+    }
 
-        if (len < 1)
+    // Writes SRT file contents to any of the SrtFileInternal outputs.
+    template <typename Output>
+    void WriteToOutput(Output& output, bool ignoreExtra = false) const
+    {
+        if (!IsValid())
             return;
 
-        stream.write(buffer, strnlen(buffer, sizeof(buffer)));
+        for (const SrtSubtitle& subtitle : m_subtitles)
+        {
+            subtitle.WriteToOutput(output, ignoreExtra);
+            if (ignoreExtra)
+                output.Append('\n');
+            output.FlushIfFull();
+        }
 
-        if (buffer[len - 1] != '\n')
-            stream << '\n';
+        if (!ignoreExtra)
+        {
+            output.AppendLines(m_extra);
+        }
     }
 
-    bool IsBlankLine(const std::string& str)
+    // Writes the times of the subtitles back into the text they were read from, by rewriting the digits
+    // of their timecodes in place, so the text keeps its size and everything else in it.
+    // Needs the timings recorded while reading, see SetRecordTimings, timecodes in the fixed-width
+    // HH:MM:SS,mmm format, and times under 100 hours. Indexes, text and extra text are not written.
+    // Returns false without changing the text if a timecode can't be patched.
+    // Adds the write counters to stats, when given.
+    bool PatchTimings(char* text, size_t size, SrtStats* stats = nullptr) const
     {
-        return str.find_first_not_of(" \t\n\v\f\r") == std::string::npos;
+        if (!IsValid() || m_timings.size() != m_subtitles.size())
+            return false;
+
+        auto CanPatch = [text, size](const char* timeCode, const SrtTimeCode& time)
+        {
+            return timeCode >= text && timeCode + 12 <= text + size && time.GetMilliseconds() < 100L * 60 * 60 * 1000;
+        };
+        for (size_t i = 0; i < m_subtitles.size(); i++)
+        {
+            const SrtSubtitle& subtitle = m_subtitles[i];
+            if (!CanPatch(m_timings[i].m_startTime, subtitle.m_startTime) || !CanPatch(m_timings[i].m_endTime, subtitle.m_endTime))
+                return false;
+        }
+
+        SrtStats writeStats;
+        {
+            SRTFILE_STAT(SrtFileInternal::ScopedTimer timer(writeStats.m_writeSeconds));
+            for (size_t i = 0; i < m_subtitles.size(); i++)
+            {
+                const SrtSubtitle& subtitle = m_subtitles[i];
+                SrtFileInternal::PatchTimeCode(text + (m_timings[i].m_startTime - text), subtitle.m_startTime.GetMilliseconds());
+                SrtFileInternal::PatchTimeCode(text + (m_timings[i].m_endTime - text), subtitle.m_endTime.GetMilliseconds());
+            }
+            SRTFILE_STAT(writeStats.m_bytesWritten += m_subtitles.size() * 24);
+        }
+        if (stats != nullptr)
+            stats->Add(writeStats);
+        return true;
     }
-}
 
-class SrtTimeCode
-{
-public:
-    SrtTimeCode() = default;
-    SrtTimeCode(const char* str)
+    // Patches the timings of the file loaded with LoadMapped, which must have been opened for writing.
+    // The system writes the changes to the file, at the latest when it is unmapped.
+    bool PatchMappedTimings(SrtStats* stats = nullptr) const
     {
-        SetFromString(str);
+        char* text = m_mappedFile.GetWritableText();
+        return text != nullptr && PatchTimings(text, m_mappedFile.GetText().size(), stats);
     }
-    SrtTimeCode(int hours, int minutes, int seconds, int milliseconds)
+
+    // Lists the replacements that make the buffer the subtitles were read from match them again,
+    // without touching what didn't change: one edit per index or timecodes that differ from the
+    // buffer and, with ignoreExtra, one per extra text to remove, keeping the blank line that ends
+    // the previous subtitle, and one per index or timing line that isn't in the standard form.
+    // Text, coordinates and line endings stay as they are in the buffer.
+    // Only the indexes and times of the subtitles may have changed since they were read.
+    // Returns false if a subtitle doesn't refer to the buffer anymore, or isn't in buffer order.
+    bool WriteEdits(std::string_view buffer, SrtTextEdits& edits, bool ignoreExtra = false) const
     {
-        Set(hours, minutes, seconds, milliseconds);
+        edits.Clear();
+        auto GetOffset = [buffer](std::string_view text)
+        {
+            const bool inBuffer = text.data() >= buffer.data() && text.data() + text.size() <= buffer.data() + buffer.size();
+            return inBuffer ? (size_t)(text.data() - buffer.data()) : std::string_view::npos;
+        };
+        auto RemoveExtra = [&](std::string_view extra, size_t extraStart, bool keepBlankLine)
+        {
+            const size_t keptSize = keepBlankLine ? std::min(extra.find('\n'), extra.size() - 1) + 1 : 0;
+            if (keptSize < extra.size())
+                edits.Add(extraStart + keptSize, extraStart + extra.size(), {});
+        };
+
+        // Sorting or merging subtitles moves their text away from their index and timing lines
+        size_t previousEnd = 0;
+        for (size_t i = 0; i < m_subtitles.size(); i++)
+        {
+            const SrtSubtitle& subtitle = m_subtitles[i];
+            const size_t extraStart = GetOffset(subtitle.m_extra);
+            if (extraStart == std::string_view::npos || extraStart < previousEnd)
+                return false;
+            previousEnd = extraStart + subtitle.m_extra.size();
+            if (!subtitle.m_text.empty())
+            {
+                const size_t textStart = GetOffset(subtitle.m_text);
+                if (textStart == std::string_view::npos || textStart < previousEnd)
+                    return false;
+                previousEnd = textStart + subtitle.m_text.size();
+            }
+
+            if (ignoreExtra)
+                RemoveExtra(subtitle.m_extra, extraStart, i > 0);
+            if (!subtitle.WriteEdits(buffer, extraStart + subtitle.m_extra.size(), edits, ignoreExtra))
+                return false;
+        }
+
+        if (ignoreExtra && !m_extra.empty())
+        {
+            const size_t extraStart = GetOffset(m_extra);
+            if (extraStart == std::string_view::npos || extraStart < previousEnd)
+                return false;
+            RemoveExtra(m_extra, extraStart, true);
+        }
+        return true;
     }
 
-    void Clear()
+    // Offset the timecode of all subtitle by the given number of milliseconds.
+    // A positive offset will make the subtitles appear later.
+    // A negative offset will make the subtitles appear sooner. 
+    void OffsetInMilliseconds(long offset)
     {
-        *this = {};
+        OffsetInMilliseconds(offset, GetAllSubtitles());
     }
 
-    bool IsValid() const
+    // Offsets the subtitles of the range only, as if they were the whole file:
+    // a negative offset is limited by the start of the first subtitle of the range.
+    void OffsetInMilliseconds(long offset, SrtSubtitleRange range)
     {
-        return m_timeCodeMs >= 0L;
+        range = ClipRange(range);
+        if (offset < 0 && range.GetCount() > 0)
+        {
+            const long firstSubStartTime = m_subtitles[range.m_first].m_startTime.GetMilliseconds();
+            offset = -std::min(firstSubStartTime, -offset);
+        }
+
+        for (size_t i = range.m_first; i < range.m_end; i++)
+        {
+            m_subtitles[i].OffsetInMilliseconds(offset);
+        }
+        m_timeIndex.Invalidate();
     }
 
-    bool operator<(const SrtTimeCode& other) const
+    // Renumbers all subtitles sequentially, starting at the specified index.
+    // Returns the index of the last subtitle.
+    long Renumber(long startIndex = 1L)
     {
-        return m_timeCodeMs < other.m_timeCodeMs;
+        return Renumber(startIndex, GetAllSubtitles());
     }
 
-    void Set(long hours, long minutes, long seconds, long milliseconds)
+    // Renumbers the subtitles of the range only, starting at the specified index.
+    // Returns the index of the last subtitle of the range.
+    long Renumber(long startIndex, SrtSubtitleRange range)
     {
-        m_timeCodeMs = milliseconds;
-        m_timeCodeMs += seconds * 1000;
-        m_timeCodeMs += minutes * 60 * 1000;
-        m_timeCodeMs += hours * 60 * 60 * 1000;
-        m_timeCodeMs = std::max(m_timeCodeMs, 0L);
+        range = ClipRange(range);
+        startIndex = std::max(startIndex, 1L);
+        for (size_t i = range.m_first; i < range.m_end; i++)
+        {
+            m_subtitles[i].SetIndex(startIndex + (long)(i - range.m_first));
+        }
+        return startIndex + ((long)range.GetCount() - 1);
     }
 
-    void SetMilliseconds(long milliseconds)
+    // Scales the timecode of all subtitles, ex: 25.0 / 23.976 to convert from 23.976 to 25 fps.
+    // The scale must be positive. Times are rounded to the nearest millisecond.
+    void ScaleTimes(double scale)
     {
-        m_timeCodeMs = milliseconds;
+        RemapTimes(scale, 0L);
     }
 
-    bool SetFromString(const std::string& str)
+    void ScaleTimes(double scale, SrtSubtitleRange range)
     {
-        int hours, minutes, seconds, milliseconds;
-        int nbValues = sscanf_s(str.c_str(), "%02d:%02d:%02d,%03d", &hours, &minutes, &seconds, &milliseconds);
-        if (nbValues == 4)
-            Set(hours, minutes, seconds, milliseconds);
-        return nbValues == 4;
+        RemapTimes(scale, 0L, range);
     }
 
-    void Get(int& hours, int& minutes, int& seconds, int& milliseconds) const
+    // Scales the timecode of all subtitles, then offsets them by the given number of milliseconds.
+    // Times are rounded to the nearest millisecond, and clamped to zero.
+    void RemapTimes(double scale, long offset)
     {
-        long remainder = std::max(m_timeCodeMs, 0L);
-        hours = remainder / (60 * 60 * 1000);
-        remainder -= hours * 60 * 60 * 1000;
-        minutes = remainder / (60 * 1000);
-        remainder -= minutes * 60 * 1000;
-        seconds = remainder / 1000;
-        milliseconds = remainder - seconds * 1000;
+        RemapTimes(scale, offset, GetAllSubtitles());
     }
 
-    long GetMilliseconds() const
+    void RemapTimes(double scale, long offset, SrtSubtitleRange range)
     {
-        return m_timeCodeMs;
+        range = ClipRange(range);
+        for (size_t i = range.m_first; i < range.m_end; i++)
+        {
+            SrtSubtitle& subtitle = m_subtitles[i];
+            subtitle.m_startTime.SetMilliseconds(SrtFileInternal::RemapTime((int32_t)subtitle.m_startTime.GetMilliseconds(), scale, (double)offset));
+            subtitle.m_endTime.SetMilliseconds(SrtFileInternal::RemapTime((int32_t)subtitle.m_endTime.GetMilliseconds(), scale, (double)offset));
+        }
+        m_timeIndex.Invalidate();
     }
 
-    void WriteToString(std::string& str) const
+    // Converts the times of all subtitles to another frame rate, see SrtFrameRateConversion.
+    void ConvertFrameRate(const SrtFrameRateConversion& conversion)
     {
-        int hours, minutes, seconds, milliseconds;
-        Get(hours, minutes, seconds, milliseconds);
-        char textBuffer[16];
-        std::snprintf(textBuffer, sizeof(textBuffer), "%02d:%02d:%02d,%03d", hours, minutes, seconds, milliseconds);
-        str.assign(textBuffer);
+        ConvertFrameRate(conversion, GetAllSubtitles());
     }
 
-    void OffsetInMilliseconds(long offset)
+    void ConvertFrameRate(const SrtFrameRateConversion& conversion, SrtSubtitleRange range)
     {
-        m_timeCodeMs = std::max(m_timeCodeMs + offset, 0L);
+        range = ClipRange(range);
+        for (size_t i = range.m_first; i < range.m_end; i++)
+            conversion.Convert(m_subtitles[i]);
+        m_timeIndex.Invalidate();
     }
 
-private:
-    long m_timeCodeMs = -1;
-};
+    // Moves the times of all subtitles through the anchors of the map, see SrtResyncMap.
+    // Start and end times each keep their place in the anchors, so a sorted file is mapped in O(n + k).
+    void Resync(const SrtResyncMap& map)
+    {
+        Resync(map, GetAllSubtitles());
+    }
 
-class SrtSubtitle
-{
-public:
-    SrtSubtitle() = default;
-    SrtSubtitle(std::iostream& stream)
+    void Resync(const SrtResyncMap& map, SrtSubtitleRange range)
     {
-        ReadFromFile(stream);
+        range = ClipRange(range);
+        size_t startSegment = 0;
+        size_t endSegment = 0;
+        for (size_t i = range.m_first; i < range.m_end; i++)
+        {
+            SrtSubtitle& subtitle = m_subtitles[i];
+            subtitle.m_startTime.SetMilliseconds(map.MapTime(subtitle.m_startTime.GetMilliseconds(), startSegment));
+            subtitle.m_endTime.SetMilliseconds(map.MapTime(subtitle.m_endTime.GetMilliseconds(), endSegment));
+        }
+        m_timeIndex.Invalidate();
     }
 
-    void Clear()
+    SrtSubtitleRange GetAllSubtitles() const
     {
-        *this = {};
+        return { 0, m_subtitles.size() };
     }
 
-    bool IsValid() const
+    // Returns the subtitles starting from the start time until the end time, excluded, found by binary search.
+    // The subtitles must be in order of start time, as in almost all files.
+    SrtSubtitleRange FindSubtitlesStartingBetween(long start, long end) const
     {
-        return m_index >= 0L && m_startTime.IsValid() && m_endTime.IsValid();
+        const size_t first = FindFirstStartingAt(start);
+        return { first, std::max(first, FindFirstStartingAt(end)) };
     }
 
-    bool ReadFromFile(std::istream& stream)
+    // Returns the first subtitle starting at or after the time, or the number of subtitles if none.
+    // The subtitles must be in order of start time.
+    size_t FindFirstStartingAt(long time) const
     {
-        if (!stream.good())
-            return false;
+        auto it = std::partition_point(m_subtitles.begin(), m_subtitles.end(),
+            [time](const SrtSubtitle& subtitle) { return subtitle.m_startTime.GetMilliseconds() < time; });
+        return (size_t)(it - m_subtitles.begin());
+    }
 
-        bool lastLineValid = false;
-        std::string lastLine;
-        std::string curLine;
-        auto SkipCurLine = [&]()
+    // Sets negative timecodes to zero.
+    void ClampTimes()
+    {
+        for (SrtSubtitle& subtitle : m_subtitles)
         {
-            if (lastLineValid)
-                m_extra.append(lastLine + '\n');
-            lastLine = curLine;
-            lastLineValid = true;
-        };
+            subtitle.m_startTime.SetMilliseconds(std::max(subtitle.m_startTime.GetMilliseconds(), 0L));
+            subtitle.m_endTime.SetMilliseconds(std::max(subtitle.m_endTime.GetMilliseconds(), 0L));
+        }
+        m_timeIndex.Invalidate();
+    }
+
+    // Sorts the subtitles by start time, keeping the ones that start at the same time in file order.
+    // The extra text stays in place between the subtitles. Returns false if they were already sorted.
+    bool SortByStartTime()
+    {
+        const size_t count = m_subtitles.size();
+        auto GetStart = [this](size_t subtitle) { return m_subtitles[subtitle].m_startTime.GetMilliseconds(); };
+        bool sorted = true;
+        for (size_t i = 1; i < count && sorted; i++)
+            sorted = GetStart(i - 1) <= GetStart(i);
+        if (sorted)
+            return false;
+
+        std::vector<std::pair<long, size_t>> starts(count);
+        for (size_t i = 0; i < count; i++)
+            starts[i] = { GetStart(i), i };
+        SrtFileInternal::SortMostlySorted(starts);
 
-        while (SrtFileInternal::ReadLine(stream, curLine))
+        std::vector<SrtSubtitle> subtitles(count);
+        for (size_t i = 0; i < count; i++)
         {
-            // Look for a line with timecode arrow
-            size_t arrowPos = curLine.find("-->");
-            if (arrowPos == std::string::npos ||                        // No arrow on line
-                !m_startTime.SetFromString(curLine) ||                  // Unreadable start time
-                !m_endTime.SetFromString(curLine.substr(arrowPos + 3))) // Unreadable end time
-            {
-                SkipCurLine();
-                continue;
-            }
+            subtitles[i] = m_subtitles[starts[i].second];
+            subtitles[i].m_extra = m_subtitles[i].m_extra;
+        }
+        m_subtitles.swap(subtitles);
 
-            if (m_endTime < m_startTime)
-            {
-                m_endTime.SetMilliseconds(m_startTime.GetMilliseconds() + 1);
-            }
+        // The recorded timings don't follow the subtitles' new order
+        m_timings.clear();
+        m_timeIndex.Invalidate();
+        return true;
+    }
 
-            // Read optional coordinates
-            size_t lastCommaPos = curLine.find_last_of(',');
-            if (lastCommaPos != std::string::npos && lastCommaPos + 5 < curLine.size())
-            {
-                m_coordinates = curLine.substr(lastCommaPos + 5);
-            }
+    // Sorts the subtitles by start time, then fixes in a single pass each subtitle that overlaps the
+    // previous one, or starts less than minGap milliseconds after it ends. When trimming would leave
+    // the previous subtitle without any duration, the subtitle is pushed instead. Subtitles keep their
+    // index, so renumber them afterwards. Returns the number of subtitles fixed.
+    size_t RepairTimings(SrtOverlapPolicy policy, long minGap = 0)
+    {
+        minGap = std::max(minGap, 0L);
+        SortByStartTime();
+        if (m_subtitles.empty())
+            return 0;
+
+        size_t fixedCount = 0;
+        size_t last = 0;                    // Last subtitle kept, with the merged ones removed
+        std::string mergedExtra;            // Text other than blank lines before the merged subtitles
+        for (size_t i = 1; i < m_subtitles.size(); i++)
+        {
+            SrtSubtitle& previous = m_subtitles[last];
+            SrtSubtitle& subtitle = m_subtitles[i];
+            const long previousEnd = previous.m_endTime.GetMilliseconds();
+            const long startTime = subtitle.m_startTime.GetMilliseconds();
+            const bool fix = startTime < previousEnd + minGap;
+            fixedCount += fix;
 
-            // Try to read subtitle index
-            if (lastLine.find_first_of("0123456789") == std::string::npos ||    // No numbers on line
-                sscanf_s(lastLine.c_str(), "%d", &m_index) == 0)                // Unreadable number
+            if (fix && policy == SrtOverlapPolicy::Merge)
             {
-                SkipCurLine();
+                previous.m_endTime.SetMilliseconds(std::max(previousEnd, subtitle.m_endTime.GetMilliseconds()));
+                AppendText(previous, subtitle.m_text);
+                if (subtitle.m_extra.find_first_not_of(" \t\r\n") != std::string_view::npos)
+                    mergedExtra.append(subtitle.m_extra);
                 continue;
             }
-            
-            // Read subtitle text lines
-            std::istream::pos_type lineStart = stream.tellg();
-            while (SrtFileInternal::ReadLine(stream, curLine))
+
+            if (fix && policy == SrtOverlapPolicy::TrimPrevious && startTime - minGap > previous.m_startTime.GetMilliseconds())
+                previous.m_endTime.SetMilliseconds(startTime - minGap);
+            else if (fix)
+                subtitle.OffsetInMilliseconds(previousEnd + minGap - startTime);
+
+            if (!mergedExtra.empty())
             {
-                if (SrtFileInternal::IsBlankLine(curLine))
-                {
-                    stream.seekg(lineStart); // Blank line is not part of subtitle
-                    break;
-                }
-                m_textLines.push_back(curLine);
-                lineStart = stream.tellg();
+                mergedExtra.append(subtitle.m_extra);
+                subtitle.m_extra = StoreText(mergedExtra);
+                mergedExtra.clear();
             }
+            if (++last != i)
+                m_subtitles[last] = subtitle;
+        }
 
-            break;
+        if (!mergedExtra.empty())
+            m_extra = StoreText(mergedExtra.append(m_extra));
+        if (last + 1 < m_subtitles.size())
+        {
+            m_subtitles.resize(last + 1);
+            m_timings.clear();
         }
+        m_timeIndex.Invalidate();
+        return fixedCount;
+    }
 
-        return IsValid();
+    // Returns the index of the subtitles by time, built the first time it is needed after the subtitles
+    // or their times change. Building it is not thread safe, so call this once before querying from
+    // several threads. Renumbering keeps it, since it refers to the subtitles by position.
+    const SrtTimeIndex& GetTimeIndex() const
+    {
+        if (!m_timeIndex.IsBuilt())
+            m_timeIndex.Build(m_subtitles);
+        return m_timeIndex;
     }
 
-    void WriteToFile(std::ostream& stream, bool ignoreExtra) const
+    // To call after changing the times of m_subtitles directly, or adding or removing subtitles.
+    void InvalidateTimeIndex()
     {
-        if (!IsValid() || !stream.good())
+        m_timeIndex.Invalidate();
+    }
+
+    // Finds the subtitles shown at the given time, as positions in m_subtitles, in order of start time.
+    void FindSubtitlesAt(long time, std::vector<size_t>& subtitles) const
+    {
+        subtitles.clear();
+        GetTimeIndex().ForEachAt(time, [&subtitles](size_t subtitle) { subtitles.push_back(subtitle); });
+    }
+
+    // Finds the subtitles shown at some point from start to end, end excluded,
+    // as positions in m_subtitles, in order of start time.
+    void FindSubtitlesBetween(long start, long end, std::vector<size_t>& subtitles) const
+    {
+        subtitles.clear();
+        GetTimeIndex().ForEachBetween(start, end, [&subtitles](size_t subtitle) { subtitles.push_back(subtitle); });
+    }
+
+    // Copies the given text into storage owned by the file, and returns a view of the copy.
+    // Use this or the setters below to modify subtitle text without keeping the original buffer alive, ex:
+    //  srtFile.m_subtitles[0].m_text = srtFile.StoreText("New text");
+    //  srtFile.SetText(srtFile.m_subtitles[0], text + " (continued)");
+    std::string_view StoreText(std::string_view text)
+    {
+        return m_storage.Store(text);
+    }
+
+    void SetText(SrtSubtitle& subtitle, std::string_view text)
+    {
+        subtitle.m_text = StoreText(text);
+    }
+
+    void SetTextLines(SrtSubtitle& subtitle, const std::vector<std::string>& textLines)
+    {
+        size_t size = 0;
+        for (const std::string& textLine : textLines)
+            size += textLine.size() + 1;
+
+        subtitle.m_text = {};
+        if (size == 0)
             return;
 
-        if (!ignoreExtra)
+        char* text = m_storage.Allocate(size);
+        subtitle.m_text = std::string_view(text, size - 1);
+        for (const std::string& textLine : textLines)
         {
-            SrtFileInternal::WriteLine(stream, m_extra.c_str());
+            std::memcpy(text, textLine.data(), textLine.size());
+            text += textLine.size();
+            *text++ = '\n';
         }
+    }
 
-        SrtFileInternal::WriteLine(stream, "%d", m_index);
-        
-        std::string startTimeCodeStr, endTimeCodeStr;
-        m_startTime.WriteToString(startTimeCodeStr);
-        m_endTime.WriteToString(endTimeCodeStr);
-        SrtFileInternal::WriteLine(stream, "%s --> %s%s%s", startTimeCodeStr.c_str(), endTimeCodeStr.c_str(), m_coordinates.empty() ? "" : " ", m_coordinates.c_str());
-
-        for (const std::string& textLine : m_textLines) 
+    // Adds lines after the text of the subtitle, unless it already has the same text.
+    void AppendText(SrtSubtitle& subtitle, std::string_view text)
+    {
+        if (text.empty() || text == subtitle.m_text)
+            return;
+        if (subtitle.m_text.empty())
         {
-            SrtFileInternal::WriteLine(stream, "%s", textLine.c_str());
+            subtitle.m_text = text;
+            return;
         }
+
+        const size_t size = subtitle.m_text.size() + 1 + text.size();
+        char* merged = m_storage.Allocate(size);
+        std::memcpy(merged, subtitle.m_text.data(), subtitle.m_text.size());
+        merged[subtitle.m_text.size()] = '\n';
+        std::memcpy(merged + subtitle.m_text.size() + 1, text.data(), text.size());
+        subtitle.m_text = std::string_view(merged, size);
     }
 
-    void OffsetInMilliseconds(long offset)
+    void SetCoordinates(SrtSubtitle& subtitle, std::string_view coordinates)
     {
-        m_startTime.OffsetInMilliseconds(offset);
-        m_endTime.OffsetInMilliseconds(offset);
+        subtitle.m_coordinates = StoreText(coordinates);
     }
 
-    void SetIndex(long index)
+    void SetExtra(SrtSubtitle& subtitle, std::string_view extra)
     {
-        m_index = index;
+        subtitle.m_extra = StoreText(extra);
     }
 
-public:
-    long m_index = -1;
-    SrtTimeCode m_startTime;
-    SrtTimeCode m_endTime;
-    std::string m_coordinates;
-    std::vector<std::string> m_textLines;
-    std::string m_extra;
-};
+    // Sets the text after the last subtitle.
+    void SetExtra(std::string_view extra)
+    {
+        m_extra = StoreText(extra);
+    }
 
-class SrtFile
-{
-public:
-    SrtFile() = default;
-    SrtFile(std::istream& stream)
+    // Copies all the text used by the subtitles into a single block, and releases everything else:
+    // text replaced by edits, the buffer read from a stream, and the mapped file.
+    // After compacting, the buffer given to ReadFromBuffer is not used anymore.
+    void CompactText()
     {
-        ReadFromFile(stream);
+        size_t size = m_extra.size();
+        for (const SrtSubtitle& subtitle : m_subtitles)
+            size += subtitle.m_extra.size() + subtitle.m_coordinates.size() + subtitle.m_text.size();
+
+        SrtFileInternal::TextStorage storage;
+        char* text = size > 0 ? storage.Allocate(size) : nullptr;
+        auto MoveText = [&text](std::string_view& view)
+        {
+            if (view.empty())
+            {
+                view = {};
+                return;
+            }
+            std::memcpy(text, view.data(), view.size());
+            view = std::string_view(text, view.size());
+            text += view.size();
+        };
+
+        for (SrtSubtitle& subtitle : m_subtitles)
+        {
+            MoveText(subtitle.m_extra);
+            MoveText(subtitle.m_coordinates);
+            MoveText(subtitle.m_text);
+        }
+        MoveText(m_extra);
+
+        m_storage = std::move(storage);
+        m_mappedFile.Close();
+        m_timings.clear();
     }
 
-    void Clear()
+private:
+    SrtSubtitleRange ClipRange(SrtSubtitleRange range) const
     {
-        *this = {};
+        range.m_end = std::min(range.m_end, m_subtitles.size());
+        range.m_first = std::min(range.m_first, range.m_end);
+        return range;
     }
 
-    bool IsValid() const
+    // Timings recorded while reading, one per subtitle when recording, or null.
+    std::vector<SrtFileInternal::TimingPosition>* GetTimings()
     {
-        return !m_subtitles.empty();
+        if (!m_recordTimings)
+            return nullptr;
+        m_timings.resize(m_subtitles.size());
+        return &m_timings;
     }
 
-    // Reads an SRT file from the given stream.
-    // Can use a std::fstream or a std::stringstream. 
-    bool ReadFromFile(std::istream& stream)
+    // Parses subtitles up to the end of the buffer, and returns the trailing text that is not a subtitle.
+    // The timings of the subtitles are also recorded when a vector is given for them.
+    static std::string_view ReadChunk(std::string_view buffer, std::vector<SrtSubtitle>& subtitles,
+        std::vector<SrtFileInternal::TimingPosition>* timings, SrtStats& stats)
     {
-        if (!stream.good())
-            return false;
+        const size_t firstSubtitle = subtitles.size();
+        SRTFILE_STAT(size_t capacity = subtitles.capacity());
 
+        // The array is sized once, from the size of the first subtitles, with some margin
+        const size_t sampleCount = 64;
+        subtitles.reserve(firstSubtitle + sampleCount);
+        SRTFILE_STAT(stats.m_subtitleArrayGrowths += subtitles.capacity() != capacity);
+        SRTFILE_STAT(capacity = subtitles.capacity());
+
+        SrtFileInternal::LineReader reader(buffer);
         SrtSubtitle subtitle;
-        while (subtitle.ReadFromFile(stream))
+        while (subtitle.ReadFromBuffer(reader))
         {
-            m_subtitles.emplace_back(std::move(subtitle));
+            if (timings != nullptr)
+                timings->push_back(SrtFileInternal::FindTimingPosition(subtitle.m_extra.data() + subtitle.m_extra.size(), buffer.data() + buffer.size()));
+            subtitles.emplace_back(std::move(subtitle));
             subtitle.Clear();
+            if (subtitles.size() - firstSubtitle == sampleCount)
+            {
+                const size_t sampleSize = reader.GetPosition();
+                const size_t estimate = (buffer.size() - sampleSize) / std::max<size_t>(sampleSize / sampleCount, 1);
+                subtitles.reserve(subtitles.size() + estimate + estimate / 8);
+            }
+            SRTFILE_STAT(stats.m_subtitleArrayGrowths += subtitles.capacity() != capacity);
+            SRTFILE_STAT(capacity = subtitles.capacity());
         }
 
-		if (!subtitle.IsValid() && !subtitle.m_extra.empty())
-			m_extra = subtitle.m_extra;
-
-        return IsValid();
+#if defined(SRTFILE_STATS)
+        SrtStats& readerStats = reader.GetStats();
+        readerStats.m_cuesAccepted = subtitles.size() - firstSubtitle;
+        readerStats.m_extraLines = readerStats.m_linesRead - readerStats.m_subtitleLines;
+        stats.Add(readerStats);
+#else
+        (void)stats;
+#endif
+        return subtitle.m_extra;
     }
 
-    // Writes SRT file contents to the given stream.
-    // Can use a std::fstream or a std::stringstream. 
-    void WriteToFile(std::ostream& stream, bool ignoreExtra = false) const
+#if !defined(SRTFILE_NO_THREADS)
+    // Splits the buffer at subtitle boundaries and parses the chunks in parallel.
+    // The text between the last subtitle of a chunk and the end of the chunk becomes
+    // the start of the extra text of the first subtitle in the next chunk.
+    bool ReadChunks(std::string_view buffer, size_t chunkCount)
     {
-        if (!IsValid() || !stream.good())
-            return;
-
-		for (const SrtSubtitle& subtitle :  m_subtitles)
+        std::vector<size_t> chunkStarts = { 0 };
+        for (size_t i = 1; i < chunkCount; i++)
         {
-            subtitle.WriteToFile(stream, ignoreExtra);
-            if (ignoreExtra)
-			    SrtFileInternal::WriteLine(stream, "\n");
+            size_t start = SrtFileInternal::FindCueBoundary(buffer, std::max(buffer.size() * i / chunkCount, chunkStarts.back()));
+            if (start == std::string_view::npos)
+                break;
+            chunkStarts.push_back(start);
         }
+        chunkStarts.push_back(buffer.size());
+        chunkCount = chunkStarts.size() - 1;
 
-        if (!ignoreExtra && !m_extra.empty())
+        std::vector<std::vector<SrtSubtitle>> chunkSubtitles(chunkCount);
+        std::vector<std::vector<SrtFileInternal::TimingPosition>> chunkTimings(m_recordTimings ? chunkCount : 0);
+        std::vector<std::string_view> trailingExtras(chunkCount);
+        std::vector<SrtStats> chunkStats(chunkCount);
+        RunOnThreads(chunkCount, [&](size_t chunk)
         {
-            SrtFileInternal::WriteLine(stream, m_extra.c_str());
-        }
-    }
+            std::string_view chunkText = buffer.substr(chunkStarts[chunk], chunkStarts[chunk + 1] - chunkStarts[chunk]);
+            trailingExtras[chunk] = ReadChunk(chunkText, chunkSubtitles[chunk], m_recordTimings ? &chunkTimings[chunk] : nullptr, chunkStats[chunk]);
+        });
+        for (const SrtStats& stats : chunkStats)
+            m_stats.Add(stats);
 
-    // Offset the timecode of all subtitle by the given number of milliseconds.
-    // A positive offset will make the subtitles appear later.
-    // A negative offset will make the subtitles appear sooner. 
-    void OffsetInMilliseconds(long offset)
-    {
-        if (offset < 0 && !m_subtitles.empty())
+        // Join the extra text across chunk boundaries, and find where each chunk goes
+        std::vector<size_t> destinations(chunkCount);
+        size_t subtitleCount = m_subtitles.size();
+        for (size_t chunk = 0; chunk < chunkCount; chunk++)
         {
-            const long firstSubStartTime = m_subtitles[0].m_startTime.GetMilliseconds();
-            offset = -std::min(firstSubStartTime, -offset);
+            destinations[chunk] = subtitleCount;
+            subtitleCount += chunkSubtitles[chunk].size();
+            if (chunk > 0 && !chunkSubtitles[chunk].empty())
+            {
+                std::string_view& extra = chunkSubtitles[chunk].front().m_extra;
+                const char* extraStart = trailingExtras[chunk - 1].data();
+                extra = std::string_view(extraStart, (size_t)(extra.data() + extra.size() - extraStart));
+            }
         }
 
-        for (SrtSubtitle& subtitle : m_subtitles)
+        SRTFILE_STAT(m_stats.m_subtitleArrayGrowths += subtitleCount > m_subtitles.capacity());
+        if (m_recordTimings)
+            m_timings.resize(subtitleCount);
+        m_subtitles.resize(subtitleCount);
+        RunOnThreads(chunkCount, [&](size_t chunk)
         {
-            subtitle.OffsetInMilliseconds(offset);
-        }
+            std::move(chunkSubtitles[chunk].begin(), chunkSubtitles[chunk].end(), m_subtitles.begin() + destinations[chunk]);
+            if (m_recordTimings)
+                std::copy(chunkTimings[chunk].begin(), chunkTimings[chunk].end(), m_timings.begin() + destinations[chunk]);
+        });
+
+        if (!trailingExtras.back().empty())
+            m_extra = trailingExtras.back();
+
+        return IsValid();
     }
 
-    // Renumbers all subtitles sequentially, starting at the specified index.
-    // Returns the index of the last subtitle.
-    long Renumber(long startIndex = 1L)
+    // Calls the function for each task, each on its own thread.
+    template <typename Function>
+    static void RunOnThreads(size_t taskCount, Function function)
     {
-        startIndex = std::max(startIndex, 1L);
-        for (SrtSubtitle& subtitle : m_subtitles)
-        {
-            subtitle.SetIndex(startIndex++);
-        }
-        return startIndex - 1;
+        std::vector<std::thread> threads;
+        threads.reserve(taskCount - 1);
+        for (size_t task = 1; task < taskCount; task++)
+            threads.emplace_back(function, task);
+        function(0);
+        for (std::thread& thread : threads)
+            thread.join();
     }
 
+    static constexpr size_t MinChunkSize = 256 * 1024;
+#endif
+
 public:
     std::vector<SrtSubtitle> m_subtitles;
-    std::string m_extra;
+    std::string_view m_extra;
+
+private:
+    SrtFileInternal::TextStorage m_storage;
+    SrtFileInternal::MappedFile m_mappedFile;
+    SrtStats m_stats;   // Counters of the reads
+    bool m_recordTimings = false;
+    std::vector<SrtFileInternal::TimingPosition> m_timings;
+    mutable SrtTimeIndex m_timeIndex;   // Built when first used
 };
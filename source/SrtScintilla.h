@@ -0,0 +1,194 @@
+// ----------------------------------------------------------------------------
+// SrtScintilla.h
+// SRT operations on documents open in Scintilla, by Louis de Carufel.
+//
+// Keeps a SrtCueIndex for each open document, updated from its SCN_MODIFIED
+// notifications, so operations only read and parse the subtitles they change
+// instead of the whole document. In the document, only the numbers and
+// timecodes that change are replaced, as a single undo action.
+//
+// Scintilla is only called through its direct function, so any function
+// with the same signature can stand in for it, for example to run the
+// operations on other systems than Windows.
+//
+// Usage example:
+//
+//  SrtDocumentCache documentCache;
+//  ScintillaCaller scintilla(directFunction, directPointer);
+//  // For each SCN_MODIFIED notification:
+//  documentCache.OnModified(bufferId, scintilla, *notification);
+//  // When the operations are applied:
+//  documentCache.ApplyOperations(bufferId, scintilla, operations);
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "Scintilla.h"
+#include "SrtCueIndex.h"
+#include "SrtStream.h"
+#include <unordered_map>
+
+// Sends messages to a Scintilla editor through the function returned by SCI_GETDIRECTFUNCTION.
+class ScintillaCaller
+{
+public:
+    ScintillaCaller(SciFnDirect function, sptr_t pointer) : m_function(function), m_pointer(pointer) {}
+
+    sptr_t Call(unsigned int message, uptr_t wParam = 0, sptr_t lParam = 0) const
+    {
+        return m_function(m_pointer, message, wParam, lParam);
+    }
+
+    size_t GetLength() const
+    {
+        return (size_t)Call(SCI_GETTEXTLENGTH);
+    }
+
+    // Returns the text between two positions without copying it.
+    // The text is only valid until the document is modified.
+    std::string_view GetText(size_t start, size_t end) const
+    {
+        if (start >= end)
+            return {};
+        const char* text = (const char*)Call(SCI_GETRANGEPOINTER, start, (sptr_t)(end - start));
+        return std::string_view(text, end - start);
+    }
+
+    void ReplaceText(size_t start, size_t end, std::string_view text) const
+    {
+        Call(SCI_SETTARGETRANGE, start, (sptr_t)end);
+        Call(SCI_REPLACETARGET, text.size(), (sptr_t)text.data());
+    }
+
+    // Applies edits of the text found at the given position, as a single undo action.
+    // They are applied from the last to the first, so the positions of the others don't move.
+    void ApplyEdits(size_t position, const SrtTextEdits& edits) const
+    {
+        if (edits.IsEmpty())
+            return;
+
+        Call(SCI_BEGINUNDOACTION);
+        for (size_t i = edits.GetCount(); i-- > 0;)
+        {
+            const SrtTextEdits::Edit edit = edits.GetEdit(i);
+            ReplaceText(position + edit.m_start, position + edit.m_end, edit.m_text);
+        }
+        Call(SCI_ENDUNDOACTION);
+    }
+
+private:
+    SciFnDirect m_function;
+    sptr_t m_pointer;
+};
+
+// Cue indexes of the open documents, identified by a unique value such as the Notepad++ buffer ID.
+// An index is built the first time operations are applied to its document.
+class SrtDocumentCache
+{
+public:
+    bool IsEmpty() const
+    {
+        return m_indexes.empty();
+    }
+
+    // To call for each SCN_MODIFIED notification of a document, which is sent after the modification.
+    void OnModified(uptr_t documentId, const ScintillaCaller& scintilla, const SCNotification& notification)
+    {
+        if ((notification.modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) == 0)
+            return;
+
+        auto it = m_indexes.find(documentId);
+        if (it == m_indexes.end())
+            return;
+
+        const size_t position = (size_t)notification.position;
+        const size_t length = (size_t)notification.length;
+        if (notification.modificationType & SC_MOD_INSERTTEXT)
+            it->second.OnInsert(position, length, scintilla.GetLength());
+        else
+            it->second.OnDelete(position, length, scintilla.GetLength());
+    }
+
+    // To call when a document is closed.
+    void Remove(uptr_t documentId)
+    {
+        m_indexes.erase(documentId);
+    }
+
+    // Returns the index of the document, parsing only what changed since it was last used.
+    const SrtCueIndex& UpdateIndex(uptr_t documentId, const ScintillaCaller& scintilla)
+    {
+        SrtCueIndex& cueIndex = m_indexes[documentId];
+        const size_t length = scintilla.GetLength();
+        cueIndex.Update([&](size_t start) { return scintilla.GetText(start, length); });
+        return cueIndex;
+    }
+
+    // Applies the operations to the subtitles whose index line is in the selection,
+    // or to all subtitles without a selection. Only the text of these subtitles is read,
+    // and only their numbers and timecodes that change are replaced. Timings aren't repaired.
+    // Returns the number of subtitles written.
+    size_t ApplyOperations(uptr_t documentId, const ScintillaCaller& scintilla, const SrtStreamOperations& operations)
+    {
+        const SrtCueIndex& cueIndex = UpdateIndex(documentId, scintilla);
+
+        const size_t selectionStart = (size_t)scintilla.Call(SCI_GETSELECTIONSTART);
+        const size_t selectionEnd = (size_t)scintilla.Call(SCI_GETSELECTIONEND);
+        const bool hasSelection = selectionStart != selectionEnd;
+
+        const size_t cueCount = cueIndex.GetCueCount();
+        const size_t firstCue = hasSelection ? cueIndex.FindCue(selectionStart) : 0;
+        const size_t endCue = hasSelection ? cueIndex.FindCue(selectionEnd) : cueCount;
+        if (firstCue >= endCue)
+            return 0;
+
+        // The extra text before the first subtitle is only removed up to the blank line that ends
+        // the previous subtitle. The text after the last subtitle of the document is also removed
+        // when the selection includes it.
+        const bool removeExtra = operations.m_removeExtra;
+        const SrtCueIndex::Cue first = cueIndex.GetCue(firstCue);
+        size_t start = first.m_indexStart;
+        if (removeExtra)
+        {
+            const std::string_view extra = scintilla.GetText(first.m_start, first.m_indexStart);
+            start = firstCue > 0 ? first.m_start + std::min(extra.find('\n'), extra.size() - 1) + 1 : 0;
+        }
+        const size_t cuesEnd = cueIndex.GetCueEnd(endCue - 1);
+        size_t end = cuesEnd;
+        if (removeExtra && endCue == cueCount && (!hasSelection || selectionEnd > end))
+            end = scintilla.GetLength();
+
+        const std::string_view text = scintilla.GetText(start, end);
+        SrtFile srtFile{ text };
+        if (!srtFile.IsValid())
+            return 0;
+
+        // Repairing timings sorts and merges subtitles, which edits in place can't follow
+        SrtStreamOperations editOperations = operations;
+        editOperations.m_repairTimings = false;
+        editOperations.ApplyTo(srtFile);
+
+        // Only the numbers and timecodes that change are replaced, so the rest of the
+        // document, its line endings and the selection are left as they are
+        if (!srtFile.WriteEdits(text, m_edits, removeExtra))
+            return 0;
+
+        // Positions of the subtitles after the edits, so the index doesn't parse them again
+        auto MapPosition = [&](size_t position) { return start + m_edits.MapPosition(position - start); };
+        m_cues.clear();
+        for (const SrtSubtitle& subtitle : srtFile.m_subtitles)
+        {
+            const size_t extraStart = start + (size_t)(subtitle.m_extra.data() - text.data());
+            const size_t cueStart = m_cues.empty() ? first.m_start : MapPosition(extraStart);
+            m_cues.push_back({ cueStart, MapPosition(extraStart + subtitle.m_extra.size()) });
+        }
+
+        scintilla.ApplyEdits(start, m_edits);
+        m_indexes[documentId].OnRewrite(firstCue, endCue, m_cues, MapPosition(cuesEnd), scintilla.GetLength());
+        return srtFile.m_subtitles.size();
+    }
+
+private:
+    std::unordered_map<uptr_t, SrtCueIndex> m_indexes;
+    SrtTextEdits m_edits;
+    std::vector<SrtCueIndex::Cue> m_cues;
+};
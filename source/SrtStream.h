@@ -0,0 +1,265 @@
+// ----------------------------------------------------------------------------
+// SrtStream.h
+// Streaming SRT reader and writer, by Louis de Carufel.
+//
+// Alternative to SrtFile for inputs too large to keep in memory.
+// SrtReader parses one subtitle at a time from a std::istream, and only
+// keeps the current subtitle and a read buffer in memory. Extra text between
+// subtitles can be written as it is read, see SrtReader::ReadNext.
+// SrtWriter writes subtitles one at a time, as SrtFile::WriteToFile does.
+// Together they give the same output as SrtFile, so operations can run as
+// a transform from any stream to any other, such as std::cin to std::cout.
+//
+// Usage example:
+//
+//  SrtReader reader(std::cin);
+//  SrtWriter writer(std::cout);
+//  SrtSubtitle subtitle;
+//  while (reader.ReadNext(subtitle))
+//  {
+//      subtitle.OffsetInMilliseconds(2000);
+//      writer.Write(subtitle);
+//  }
+//  writer.WriteExtra(reader.GetExtra());
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "SrtFile.h"
+#include <limits>
+
+class SrtReader
+{
+public:
+    SrtReader(std::istream& stream) : m_stream(stream) {}
+    SrtReader(const SrtReader&) = delete;
+    SrtReader& operator=(const SrtReader&) = delete;
+
+    // Reads the next subtitle, and returns false when there are no more subtitles.
+    // The subtitle refers to text owned by the reader, which is only valid until the next call.
+    bool ReadNext(SrtSubtitle& subtitle)
+    {
+        return Read(subtitle, [](std::string_view) {}, false);
+    }
+
+    // Same, but once a subtitle has been read, complete lines of extra text are given to writeExtra
+    // as they are read instead of being kept until the next subtitle is found. The subtitle's m_extra
+    // and GetExtra then only hold the rest of the extra text.
+    template <typename ExtraWriter>
+    bool ReadNext(SrtSubtitle& subtitle, ExtraWriter&& writeExtra)
+    {
+        return Read(subtitle, writeExtra, true);
+    }
+
+    // Text after the last subtitle, once ReadNext has returned false.
+    std::string_view GetExtra() const
+    {
+        return m_extra;
+    }
+
+private:
+    template <typename ExtraWriter>
+    bool Read(SrtSubtitle& subtitle, ExtraWriter&& writeExtra, bool passExtra)
+    {
+        for (;;)
+        {
+            subtitle.Clear();
+            m_position = m_reader.GetPosition();
+            const bool found = subtitle.ReadFromBuffer(m_reader);
+
+            // A subtitle is only complete once the blank line after its text has been read,
+            // otherwise read more of the stream and parse it again
+            if (m_endOfStream || (found && m_reader.GetPosition() < m_lineEnd))
+            {
+                if (!found)
+                    m_extra = subtitle.m_extra;
+                m_hasSubtitle |= found;
+                return found;
+            }
+
+            // Without a subtitle, all lines are extra text but the last one, which can be an index line.
+            // Nothing is written for files without subtitles, so the text is kept until the first one.
+            if (!found && passExtra && m_hasSubtitle && m_lineEnd > m_position + 1)
+            {
+                const size_t lastLineStart = m_buffer.rfind('\n', m_lineEnd - 2) + 1;
+                if (lastLineStart > m_position)
+                {
+                    writeExtra(std::string_view(m_buffer).substr(m_position, lastLineStart - m_position));
+                    m_position = lastLineStart;
+                }
+            }
+            ReadMore();
+        }
+    }
+
+    // Drops the text before the current subtitle, and reads at least one more line from the stream.
+    // At least as much as the buffer holds is read, so text parsed again is linear in the stream size.
+    void ReadMore()
+    {
+        m_buffer.erase(0, m_position);
+        size_t searchStart = m_lineEnd - m_position;
+        m_position = 0;
+
+        for (;;)
+        {
+            const size_t size = m_buffer.size();
+            const size_t readSize = std::max(ChunkSize, size);
+            m_buffer.resize(size + readSize);
+            m_stream.read(&m_buffer[size], (std::streamsize)readSize);
+            m_buffer.resize(size + (size_t)m_stream.gcount());
+            m_endOfStream = !m_stream.good();
+
+            if (m_endOfStream || m_buffer.find('\n', searchStart) != std::string::npos)
+                break;
+            searchStart = m_buffer.size();
+        }
+
+        // Only parse complete lines, until the last line of the stream
+        m_lineEnd = m_endOfStream ? m_buffer.size() : m_buffer.rfind('\n') + 1;
+        m_reader = SrtFileInternal::LineReader(std::string_view(m_buffer.data(), m_lineEnd));
+    }
+
+    static constexpr size_t ChunkSize = 64 * 1024;
+
+    std::istream& m_stream;
+    std::string m_buffer;
+    SrtFileInternal::LineReader m_reader{ std::string_view() };
+    size_t m_position = 0;      // Start of the current subtitle in the buffer
+    size_t m_lineEnd = 0;       // End of the last complete line in the buffer
+    bool m_endOfStream = false;
+    bool m_hasSubtitle = false;
+    std::string_view m_extra;
+};
+
+class SrtWriter
+{
+public:
+    SrtWriter(std::ostream& stream, bool ignoreExtra = false) : m_output(stream), m_ignoreExtra(ignoreExtra) {}
+    SrtWriter(const SrtWriter&) = delete;
+    SrtWriter& operator=(const SrtWriter&) = delete;
+
+    void Write(const SrtSubtitle& subtitle)
+    {
+        subtitle.WriteToOutput(m_output, m_ignoreExtra);
+        if (m_ignoreExtra)
+            m_output.Append('\n');
+        m_output.FlushIfFull();
+        m_subtitleCount++;
+    }
+
+    // Writes extra text found after the subtitles written so far.
+    // Like SrtFile, nothing is written when there are no subtitles.
+    void WriteExtra(std::string_view extra)
+    {
+        if (m_subtitleCount > 0 && !m_ignoreExtra)
+            m_output.AppendLines(extra);
+    }
+
+    void Flush()
+    {
+        m_output.Flush();
+    }
+
+    size_t GetSubtitleCount() const
+    {
+        return m_subtitleCount;
+    }
+
+private:
+    SrtFileInternal::OutputBuffer m_output;
+    bool m_ignoreExtra;
+    size_t m_subtitleCount = 0;
+};
+
+// Operations applied by TransformSrtStream, with the same results as the SrtFile methods.
+struct SrtStreamOperations
+{
+    SrtFrameRateConversion m_frameRate; // Converts the times to another frame rate, before the other timing changes
+    SrtResyncMap m_resync;              // Moves the times through anchors, before the offset
+    long m_timeOffset = 0;              // Offset in milliseconds, limited by the start of the first subtitle
+    long m_startIndex = 0;              // Renumbers the subtitles from this index when positive
+    bool m_removeExtra = false;         // Removes all text that is not part of a subtitle
+
+    // The timing changes and renumbering only apply to the subtitles starting from m_rangeStart
+    // until m_rangeEnd, excluded, as found by SrtFile::FindSubtitlesStartingBetween
+    long m_rangeStart = std::numeric_limits<long>::min();
+    long m_rangeEnd = std::numeric_limits<long>::max();
+
+    // Sorts the subtitles and fixes overlaps and short gaps in the whole file, after the timing changes
+    // and before renumbering, see SrtFile::RepairTimings. Only applied by ApplyTo, since it needs
+    // all the subtitles at once, and not by the edits of SrtDocumentCache::ApplyOperations.
+    bool m_repairTimings = false;
+    SrtOverlapPolicy m_overlapPolicy = SrtOverlapPolicy::TrimPrevious;
+    long m_minGap = 0;
+
+    // Applies the timing changes and renumbering to the subtitles of a file, in place.
+    void ApplyTo(SrtFile& srtFile) const
+    {
+        SrtSubtitleRange range = srtFile.FindSubtitlesStartingBetween(m_rangeStart, m_rangeEnd);
+        if (!m_frameRate.IsEmpty())
+            srtFile.ConvertFrameRate(m_frameRate, range);
+        if (!m_resync.IsEmpty())
+            srtFile.Resync(m_resync, range);
+        if (m_timeOffset != 0)
+            srtFile.OffsetInMilliseconds(m_timeOffset, range);
+        if (m_repairTimings)
+        {
+            srtFile.RepairTimings(m_overlapPolicy, m_minGap);
+            range = srtFile.FindSubtitlesStartingBetween(m_rangeStart, m_rangeEnd);
+        }
+        if (m_startIndex > 0)
+            srtFile.Renumber(m_startIndex, range);
+    }
+};
+
+// Applies the operations to each subtitle as it goes from the input to the output.
+// Returns the number of subtitles written.
+inline size_t TransformSrtStream(std::istream& input, std::ostream& output, const SrtStreamOperations& operations)
+{
+    SrtReader reader(input);
+    SrtWriter writer(output, operations.m_removeExtra);
+    SrtSubtitle subtitle;
+    long offset = operations.m_timeOffset;
+    long index = operations.m_startIndex;
+    size_t startSegment = 0;
+    size_t endSegment = 0;
+
+    // The subtitles are in order of start time, so the range ends at the first one starting after it
+    enum class RangeState { Before, Inside, After };
+    RangeState rangeState = RangeState::Before;
+
+    auto writeExtra = [&writer](std::string_view extra) { writer.WriteExtra(extra); };
+    while (reader.ReadNext(subtitle, writeExtra))
+    {
+        const long startTime = subtitle.m_startTime.GetMilliseconds();
+        bool isFirstInRange = false;
+        if (rangeState == RangeState::Before && startTime >= operations.m_rangeStart)
+        {
+            rangeState = startTime < operations.m_rangeEnd ? RangeState::Inside : RangeState::After;
+            isFirstInRange = true;
+        }
+        else if (rangeState == RangeState::Inside && startTime >= operations.m_rangeEnd)
+        {
+            rangeState = RangeState::After;
+        }
+
+        if (rangeState == RangeState::Inside)
+        {
+            operations.m_frameRate.Convert(subtitle);
+            if (!operations.m_resync.IsEmpty())
+            {
+                subtitle.m_startTime.SetMilliseconds(operations.m_resync.MapTime(subtitle.m_startTime.GetMilliseconds(), startSegment));
+                subtitle.m_endTime.SetMilliseconds(operations.m_resync.MapTime(subtitle.m_endTime.GetMilliseconds(), endSegment));
+            }
+            if (isFirstInRange && offset < 0)
+                offset = -std::min(subtitle.m_startTime.GetMilliseconds(), -offset);
+            if (offset != 0)
+                subtitle.OffsetInMilliseconds(offset);
+            if (index > 0)
+                subtitle.SetIndex(index++);
+        }
+        writer.Write(subtitle);
+    }
+
+    writer.WriteExtra(reader.GetExtra());
+    return writer.GetSubtitleCount();
+}
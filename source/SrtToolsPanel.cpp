@@ -18,13 +18,12 @@
 #include "SrtToolsPanel.h"
 #include "PluginDefinition.h"
 #include <stdio.h>
-#include <sstream>
 #include "Commctrl.h"
 #include "richedit.h"
 
 #undef max
 #undef min
-#include "SrtFile.h"
+#include "SrtStream.h"
 
 INT_PTR CALLBACK SrtToolPanel::run_dlgProc(UINT message, WPARAM wParam, LPARAM lParam)
 {
@@ -130,57 +129,14 @@ void SrtToolPanel::applyOperations()
 	bool doRenumber = ::SendDlgItemMessage(_hSelf, ID_INDEX_CHECK, BM_GETCHECK, 0, 0) == BST_CHECKED;
 	bool doCleanupText = ::SendDlgItemMessage(_hSelf, ID_CLEANUP_CHECK, BM_GETCHECK, 0, 0) == BST_CHECKED;
 
-	// Retrieve input text from Notepad++
-	HWND hCurrScintilla = getCurrentScintillaHandle();
+	SrtStreamOperations operations;
+	operations.m_timeOffset = doOffsetTime ? timeOffset : 0;
+	operations.m_startIndex = doRenumber ? startIndex : 0;
+	operations.m_removeExtra = doCleanupText;
 
-	const char* inputText = nullptr;
-	long inputTextLength = 0;
-
-	size_t start = ::SendMessage(hCurrScintilla, SCI_GETSELECTIONSTART, 0, 0);
-	size_t end = ::SendMessage(hCurrScintilla, SCI_GETSELECTIONEND, 0, 0);
-	if (start == end)
-	{
-		// No selection, get whole document
-		inputTextLength = (long)::SendMessage(hCurrScintilla, SCI_GETTEXTLENGTH, 0, 0);
-		inputText = new char[inputTextLength+1];
-		::SendMessage(hCurrScintilla, SCI_GETTEXT, inputTextLength, (LPARAM)inputText);
-	}
-	else
-	{
-		// Get selected text
-		inputTextLength = (long)::SendMessage(hCurrScintilla, SCI_GETSELTEXT, 0, 0);
-		inputText = new char[inputTextLength+1];
-		::SendMessage(hCurrScintilla, SCI_GETSELTEXT, 0, (LPARAM)inputText);
-	}
-
-	// Parse text and apply operations to subtitles
-	std::stringstream inputStream(inputText, std::ios_base::in);
-	SrtFile srtFile(inputStream);
-	if (srtFile.IsValid())
-	{
-		if (doOffsetTime && timeOffset != 0)
-			srtFile.OffsetInMilliseconds(timeOffset);
-		if (doRenumber && startIndex > 0)
-			srtFile.Renumber(startIndex);
-	}
-
-	delete[] inputText;
-
-	// Generate output text
-	std::stringstream outputStream;
-	srtFile.WriteToFile(outputStream, doCleanupText);
-
-	// Send output text to Notepad++
-	if (start == end)
-	{
-		::SendMessage(hCurrScintilla, SCI_SETTEXT, 0, (LPARAM)outputStream.str().c_str());
-	}
-	else
-	{
-		size_t length = outputStream.str().length();
-		::SendMessage(hCurrScintilla, SCI_REPLACESEL, 0, (LPARAM)outputStream.str().c_str());
-		::SendMessage(hCurrScintilla, SCI_SETSEL, (WPARAM)start, (LPARAM)(start + length));
-	}
+	// Only the subtitles in the selection, or all of them without selection, are parsed and replaced.
+	// The positions of the subtitles in each document are kept up to date as it is edited.
+	applySrtOperations(operations);
 }
 
 LRESULT CALLBACK offsetEditSubclassProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam, UINT_PTR, DWORD_PTR)
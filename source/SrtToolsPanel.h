@@ -54,5 +54,9 @@ LRESULT CALLBACK indexEditSubclassProc(HWND hWnd, UINT message, WPARAM wParam, L
 
 HWND getCurrentScintillaHandle();
 
+// Applies the operations to the current document, see SrtDocumentCache::ApplyOperations
+struct SrtStreamOperations;
+size_t applySrtOperations(const SrtStreamOperations& operations);
+
 
 #endif //GOTILINE_DLG_H
@@ -73,6 +73,18 @@ extern "C" __declspec(dllexport) void beNotified(SCNotification *notifyCode)
 		}
 		break;
 
+		case SCN_MODIFIED:
+		{
+			onScintillaModified(notifyCode);
+		}
+		break;
+
+		case NPPN_FILECLOSED:
+		{
+			onFileClosed(notifyCode->nmhdr.idFrom);
+		}
+		break;
+
 		default:
 			return;
 	}
@@ -0,0 +1,279 @@
+// ----------------------------------------------------------------------------
+// MockScintilla.h
+// Minimal stand-in for a Scintilla editor, to run the plugin operations
+// without Windows or Notepad++.
+//
+// The document is kept in a gap buffer like Scintilla's, so series of
+// nearby edits stay fast in large documents, and the messages used by
+// SrtScintilla.h are handled by a direct function like Scintilla's own.
+// After each insertion or deletion, an SCN_MODIFIED notification is sent
+// to the given callback, as Notepad++ sends it to the plugin. Changes are
+// recorded in undo actions, grouped by SCI_BEGINUNDOACTION/SCI_ENDUNDOACTION.
+//
+// Usage example:
+//
+//  MockScintilla editor(text);
+//  SrtDocumentCache documentCache;
+//  editor.SetNotify([&](const SCNotification& notification)
+//  {
+//      documentCache.OnModified(1, editor.GetCaller(), notification);
+//  });
+//  documentCache.ApplyOperations(1, editor.GetCaller(), operations);
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "SrtScintilla.h"
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+class MockScintilla
+{
+public:
+    using NotifyFunction = std::function<void(const SCNotification&)>;
+
+    MockScintilla(std::string text = {}) : m_text(std::move(text)), m_gapStart(m_text.size()) {}
+    MockScintilla(const MockScintilla&) = delete;
+    MockScintilla& operator=(const MockScintilla&) = delete;
+
+    ScintillaCaller GetCaller()
+    {
+        return ScintillaCaller(&MockScintilla::DirectFunction, (sptr_t)this);
+    }
+
+    void SetNotify(NotifyFunction notify)
+    {
+        m_notify = std::move(notify);
+    }
+
+    size_t GetLength() const
+    {
+        return m_text.size() - m_gapLength;
+    }
+
+    // Returns the whole text, moving the gap to the end like SCI_GETCHARACTERPOINTER.
+    // The text is only valid until the document is modified.
+    std::string_view GetText()
+    {
+        MoveGap(GetLength());
+        return std::string_view(m_text.data(), GetLength());
+    }
+
+    void InsertText(size_t position, std::string_view text)
+    {
+        if (text.empty())
+            return;
+
+        ReserveGap(text.size());
+        MoveGap(position);
+        std::memcpy(m_text.data() + m_gapStart, text.data(), text.size());
+        m_gapStart += text.size();
+        m_gapLength -= text.size();
+        MovePositions([=](size_t& x) { if (x > position) x += text.size(); });
+        RecordChange(true, position, text);
+        Notify(SC_MOD_INSERTTEXT, position, text);
+    }
+
+    void DeleteText(size_t position, size_t length)
+    {
+        if (length == 0)
+            return;
+
+        MoveGap(position);
+        const std::string deletedText = m_text.substr(m_gapStart + m_gapLength, length);
+        m_gapLength += length;
+        MovePositions([=](size_t& x) { x = x >= position + length ? x - length : std::min(x, position); });
+        RecordChange(false, position, deletedText);
+        Notify(SC_MOD_DELETETEXT, position, deletedText);
+    }
+
+    // Reverts the last undo action, notifying each change.
+    bool Undo()
+    {
+        if (m_undoActions.empty() || m_undoDepth > 0)
+            return false;
+
+        const std::vector<Change> changes = std::move(m_undoActions.back());
+        m_undoActions.pop_back();
+        m_undoing = true;
+        for (auto it = changes.rbegin(); it != changes.rend(); ++it)
+        {
+            if (it->m_insert)
+                DeleteText(it->m_position, it->m_text.size());
+            else
+                InsertText(it->m_position, it->m_text);
+        }
+        m_undoing = false;
+        return true;
+    }
+
+    size_t GetUndoActionCount() const
+    {
+        return m_undoActions.size();
+    }
+
+    bool IsInUndoAction() const
+    {
+        return m_undoDepth > 0;
+    }
+
+    void SetSelection(size_t start, size_t end)
+    {
+        m_selectionStart = std::min(start, GetLength());
+        m_selectionEnd = std::min(end, GetLength());
+    }
+
+    size_t GetSelectionStart() const
+    {
+        return std::min(m_selectionStart, m_selectionEnd);
+    }
+
+    size_t GetSelectionEnd() const
+    {
+        return std::max(m_selectionStart, m_selectionEnd);
+    }
+
+private:
+    static sptr_t DirectFunction(sptr_t pointer, unsigned int message, uptr_t wParam, sptr_t lParam)
+    {
+        return reinterpret_cast<MockScintilla*>(pointer)->HandleMessage(message, wParam, lParam);
+    }
+
+    sptr_t HandleMessage(unsigned int message, uptr_t wParam, sptr_t lParam)
+    {
+        switch (message)
+        {
+            case SCI_GETTEXTLENGTH:
+                return (sptr_t)GetLength();
+
+            case SCI_GETRANGEPOINTER:
+                // The gap is moved out of the range, as Scintilla does
+                if (wParam < m_gapStart && wParam + (size_t)lParam > m_gapStart)
+                    MoveGap(wParam);
+                return (sptr_t)(m_text.data() + wParam + (wParam >= m_gapStart ? m_gapLength : 0));
+
+            case SCI_GETCHARACTERPOINTER:
+                // Followed by a null character, in the gap
+                ReserveGap(1);
+                MoveGap(GetLength());
+                m_text[m_gapStart] = '\0';
+                return (sptr_t)m_text.data();
+
+            case SCI_GETSELECTIONSTART:
+                return (sptr_t)GetSelectionStart();
+
+            case SCI_GETSELECTIONEND:
+                return (sptr_t)GetSelectionEnd();
+
+            case SCI_SETSEL:
+                SetSelection(wParam, lParam < 0 ? GetLength() : (size_t)lParam);
+                return 0;
+
+            case SCI_SETTARGETRANGE:
+                m_targetStart = wParam;
+                m_targetEnd = (size_t)lParam;
+                return 0;
+
+            case SCI_REPLACETARGET:
+            {
+                const char* text = reinterpret_cast<const char*>(lParam);
+                const size_t length = wParam == (uptr_t)-1 ? strlen(text) : wParam;
+                const std::string replacement(text, length);
+                DeleteText(m_targetStart, m_targetEnd - m_targetStart);
+                InsertText(m_targetStart, replacement);
+                m_targetEnd = m_targetStart + length;
+                return (sptr_t)length;
+            }
+
+            case SCI_BEGINUNDOACTION:
+                if (m_undoDepth++ == 0)
+                    m_undoActions.emplace_back();
+                return 0;
+
+            case SCI_ENDUNDOACTION:
+                if (m_undoDepth > 0 && --m_undoDepth == 0 && m_undoActions.back().empty())
+                    m_undoActions.pop_back();
+                return 0;
+
+            case SCI_UNDO:
+                Undo();
+                return 0;
+
+            default:
+                fprintf(stderr, "MockScintilla: message %u is not handled\n", message);
+                return 0;
+        }
+    }
+
+    template <typename Move>
+    void MovePositions(Move move)
+    {
+        move(m_selectionStart);
+        move(m_selectionEnd);
+    }
+
+    void ReserveGap(size_t size)
+    {
+        if (m_gapLength >= size)
+            return;
+
+        MoveGap(GetLength());
+        const size_t growth = size + GetLength() / 8 + 64;
+        m_text.resize(m_text.size() + growth);
+        m_gapLength += growth;
+    }
+
+    void MoveGap(size_t position)
+    {
+        if (position < m_gapStart)
+            std::memmove(m_text.data() + position + m_gapLength, m_text.data() + position, m_gapStart - position);
+        else if (position > m_gapStart)
+            std::memmove(m_text.data() + m_gapStart, m_text.data() + m_gapStart + m_gapLength, position - m_gapStart);
+        m_gapStart = position;
+    }
+
+    // Outside of SCI_BEGINUNDOACTION/SCI_ENDUNDOACTION, each change is its own undo action.
+    void RecordChange(bool insert, size_t position, std::string_view text)
+    {
+        if (m_undoing)
+            return;
+        if (m_undoDepth == 0)
+            m_undoActions.emplace_back();
+        m_undoActions.back().push_back({ insert, position, std::string(text) });
+    }
+
+    void Notify(int modificationType, size_t position, std::string_view text)
+    {
+        if (!m_notify)
+            return;
+
+        SCNotification notification = {};
+        notification.nmhdr.code = SCN_MODIFIED;
+        notification.modificationType = modificationType | (m_undoing ? SC_PERFORMED_UNDO : SC_PERFORMED_USER);
+        notification.position = (Sci_Position)position;
+        notification.length = (Sci_Position)text.size();
+        notification.text = text.data();
+        m_notify(notification);
+    }
+
+    struct Change
+    {
+        bool m_insert;
+        size_t m_position;
+        std::string m_text;
+    };
+
+    std::string m_text;             // Text before the gap, the gap, then the text after it
+    size_t m_gapStart;
+    size_t m_gapLength = 0;
+    NotifyFunction m_notify;
+    size_t m_selectionStart = 0;
+    size_t m_selectionEnd = 0;
+    size_t m_targetStart = 0;
+    size_t m_targetEnd = 0;
+    std::vector<std::vector<Change>> m_undoActions;
+    size_t m_undoDepth = 0;
+    bool m_undoing = false;
+};
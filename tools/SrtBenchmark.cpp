@@ -0,0 +1,461 @@
+// ----------------------------------------------------------------------------
+// SrtBenchmark.cpp
+// Microbenchmarks for the SrtFile library hot paths.
+//
+// Covers timecode parsing and formatting, line reading, whole file parsing,
+// offset, renumbering, resync, frame rate conversion, overlap repair,
+// writing, patching timecodes in place and finding subtitles by time, on
+// generated files of 1k, 100k and 1M subtitles: short text with LF or CRLF
+// line endings, long text, and files with extra text between the subtitles.
+//
+// Each benchmark is repeated until it has run for a minimum time, and the
+// fastest repetition is reported. Use --json to get results that can be
+// compared between runs.
+//
+// Usage: srtbenchmark [--json] [--filter <text>] [--max-cues <count>]
+//
+// Build:
+//  g++ -O2 -std=c++17 -I../source SrtBenchmark.cpp -o srtbenchmark
+//  cl /O2 /EHsc /std:c++17 /utf-8 /I..\source SrtBenchmark.cpp
+// ----------------------------------------------------------------------------
+
+#include "SrtFile.h"
+#include "SrtCueTable.h"
+#include "SrtCorpus.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Keeps the compiler from optimizing away the benchmarked work.
+    volatile long g_sink = 0;
+
+    struct Settings
+    {
+        bool m_json = false;
+        std::string m_filter;
+        size_t m_maxCueCount = 1000000;
+        double m_minSeconds = 0.25;
+    };
+
+    struct Result
+    {
+        std::string m_name;
+        int m_iterations;
+        double m_ns;            // Fastest iteration
+        size_t m_itemCount;     // Cues or lines handled per iteration
+        size_t m_byteCount;     // Input or output bytes per iteration
+    };
+
+    Settings g_settings;
+    std::vector<Result> g_results;
+
+    bool IsSelected(const std::string& name)
+    {
+        return name.find(g_settings.m_filter) != std::string::npos;
+    }
+
+    // Runs the function until the minimum time is reached, at least 3 times, and records the fastest run.
+    // The setup function runs before each iteration, and is not measured.
+    template <typename Function, typename Setup>
+    void Run(const std::string& name, size_t itemCount, size_t byteCount, Function function, Setup setup)
+    {
+        if (!IsSelected(name))
+            return;
+
+        double bestNs = 0.0;
+        double totalSeconds = 0.0;
+        int iterations = 0;
+        while (iterations < 3 || totalSeconds < g_settings.m_minSeconds)
+        {
+            setup();
+            auto start = std::chrono::steady_clock::now();
+            function();
+            auto end = std::chrono::steady_clock::now();
+            double ns = std::chrono::duration<double, std::nano>(end - start).count();
+            if (iterations == 0 || ns < bestNs)
+                bestNs = ns;
+            totalSeconds += ns * 1e-9;
+            iterations++;
+        }
+
+        g_results.push_back({ name, iterations, bestNs, itemCount, byteCount });
+        if (!g_settings.m_json)
+        {
+            printf("%-36s %12.0f ns %10.2f ns/item %10.1f MB/s\n", name.c_str(), bestNs, bestNs / (double)itemCount,
+                byteCount ? byteCount / (bestNs * 1e-9) / (1024.0 * 1024.0) : 0.0);
+            fflush(stdout);
+        }
+    }
+
+    template <typename Function>
+    void Run(const std::string& name, size_t itemCount, size_t byteCount, Function function)
+    {
+        Run(name, itemCount, byteCount, function, []() {});
+    }
+
+    // Shape of a generated SRT file.
+    struct Corpus
+    {
+        const char* m_name;
+        SrtCorpusOptions m_options;
+    };
+
+    std::string FormatCount(size_t count)
+    {
+        if (count >= 1000000 && count % 1000000 == 0)
+            return std::to_string(count / 1000000) + "M";
+        if (count >= 1000 && count % 1000 == 0)
+            return std::to_string(count / 1000) + "k";
+        return std::to_string(count);
+    }
+
+    std::vector<std::string> MakeTimingLines(size_t count)
+    {
+        std::vector<std::string> lines;
+        lines.reserve(count);
+        SrtTimeCode startTime, endTime;
+        std::string startStr, endStr;
+        for (size_t i = 0; i < count; i++)
+        {
+            startTime.SetMilliseconds((long)(i * 2500 + i % 997));
+            endTime.SetMilliseconds(startTime.GetMilliseconds() + 1800);
+            startTime.WriteToString(startStr);
+            endTime.WriteToString(endStr);
+            lines.push_back(startStr + " --> " + endStr);
+        }
+        return lines;
+    }
+
+    // Timing line parsing as done by SrtFile v1.1, with a substring copy for the end time.
+    bool ParseTimingLineScanf(const std::string& line, long& startMs, long& endMs)
+    {
+        size_t arrowPos = line.find("-->");
+        if (arrowPos == std::string::npos)
+            return false;
+
+        int hours, minutes, seconds, milliseconds;
+        if (sscanf(line.c_str(), "%02d:%02d:%02d,%03d", &hours, &minutes, &seconds, &milliseconds) != 4)
+            return false;
+        startMs = ((hours * 60L + minutes) * 60L + seconds) * 1000L + milliseconds;
+
+        if (sscanf(line.substr(arrowPos + 3).c_str(), "%02d:%02d:%02d,%03d", &hours, &minutes, &seconds, &milliseconds) != 4)
+            return false;
+        endMs = ((hours * 60L + minutes) * 60L + seconds) * 1000L + milliseconds;
+        return true;
+    }
+
+    void BenchmarkTimeCodes()
+    {
+        const size_t cueCount = 100000;
+        const std::vector<std::string> lines = MakeTimingLines(cueCount);
+        size_t byteCount = 0;
+        for (const std::string& line : lines)
+            byteCount += line.size();
+
+        Run("timing_line/sscanf", cueCount, byteCount, [&]()
+        {
+            long startMs = 0, endMs = 0;
+            for (const std::string& line : lines)
+            {
+                ParseTimingLineScanf(line, startMs, endMs);
+                g_sink = g_sink + startMs + endMs;
+            }
+        });
+
+        Run("timing_line/scan", cueCount, byteCount, [&]()
+        {
+            long startMs = 0, endMs = 0;
+            size_t timingEnd = 0;
+            for (const std::string& line : lines)
+            {
+                SrtFileInternal::ScanTimingLine(line, startMs, endMs, timingEnd);
+                g_sink = g_sink + startMs + endMs;
+            }
+        });
+
+        Run("timecode/parse", cueCount, cueCount * 12, [&]()
+        {
+            SrtTimeCode timeCode;
+            for (const std::string& line : lines)
+            {
+                timeCode.SetFromString(std::string_view(line).substr(0, 12));
+                g_sink = g_sink + timeCode.GetMilliseconds();
+            }
+        });
+
+        Run("timecode/format", cueCount, cueCount * 12, [&]()
+        {
+            char text[32];
+            for (size_t i = 0; i < cueCount; i++)
+            {
+                char* end = SrtFileInternal::FormatTimeCode(text, (long)(i * 2500 + i % 997));
+                g_sink = g_sink + (end - text) + text[11];
+            }
+        });
+    }
+
+    void BenchmarkCorpus(const Corpus& corpus)
+    {
+        static const char* const names[] = { "read_lines", "parse", "parse_table", "offset", "renumber", "offset_table",
+            "resync", "resync_table", "frame_rate", "frame_rate_table", "repair", "write", "write_cleanup", "write_string", "patch",
+            "time_index", "find_at" };
+        const std::string prefix = std::string("/") + FormatCount(corpus.m_options.m_cueCount) + "/" + corpus.m_name;
+        if (std::none_of(std::begin(names), std::end(names), [&](const char* name) { return IsSelected(name + prefix); }))
+            return;
+
+        const std::string text = SrtCorpusGenerator(corpus.m_options).GenerateString();
+        SrtFile srtFile(text);
+        const size_t cueCount = srtFile.m_subtitles.size();
+
+        size_t lineCount = 0;
+        {
+            SrtFileInternal::LineReader reader(text);
+            std::string_view line;
+            while (reader.ReadLine(line))
+                lineCount++;
+        }
+
+        Run("read_lines" + prefix, lineCount, text.size(), [&]()
+        {
+            SrtFileInternal::LineReader reader(text);
+            std::string_view line;
+            size_t length = 0;
+            while (reader.ReadLine(line))
+                length += line.size();
+            g_sink = g_sink + (long)length;
+        });
+
+        Run("parse" + prefix, cueCount, text.size(), [&]()
+        {
+            SrtFile srtFile(text);
+            g_sink = g_sink + (long)srtFile.m_subtitles.size();
+        });
+
+        Run("parse_table" + prefix, cueCount, text.size(), [&]()
+        {
+            SrtCueTable cueTable(text);
+            g_sink = g_sink + (long)cueTable.GetCueCount();
+        });
+
+        Run("offset" + prefix, cueCount, 0, [&]()
+        {
+            srtFile.OffsetInMilliseconds(1000);
+        });
+
+        Run("renumber" + prefix, cueCount, 0, [&]()
+        {
+            g_sink = g_sink + srtFile.Renumber(1);
+        });
+
+        SrtCueTable cueTable(srtFile);
+        Run("offset_table" + prefix, cueCount, 0, [&]()
+        {
+            cueTable.OffsetInMilliseconds(1000);
+        });
+
+        // An anchor every minute, as with a video that drifts back and forth
+        std::vector<SrtResyncAnchor> anchors;
+        const long lastStart = srtFile.m_subtitles.back().m_startTime.GetMilliseconds();
+        for (long time = 0; time <= lastStart; time += 60000)
+            anchors.push_back({ time, time + ((time / 60000) % 2 == 0 ? 40 : -40) });
+        const SrtResyncMap resyncMap(anchors);
+        Run("resync" + prefix, cueCount, 0, [&]()
+        {
+            srtFile.Resync(resyncMap);
+        });
+
+        Run("resync_table" + prefix, cueCount, 0, [&]()
+        {
+            cueTable.Resync(resyncMap);
+        });
+
+        // Back and forth between 23.976 and 25 fps, so times stay in the same range
+        const SrtFrameRate filmRate = SrtFrameRate::Parse("23.976");
+        const SrtFrameRate palRate = SrtFrameRate::Parse("25");
+        const SrtFrameRateConversion toPal(filmRate, palRate);
+        const SrtFrameRateConversion toFilm(palRate, filmRate);
+        bool converted = false;
+        Run("frame_rate" + prefix, cueCount, 0, [&]()
+        {
+            srtFile.ConvertFrameRate(converted ? toFilm : toPal);
+            converted = !converted;
+        });
+
+        Run("frame_rate_table" + prefix, cueCount, 0, [&]()
+        {
+            cueTable.ConvertFrameRate(converted ? toFilm : toPal);
+            converted = !converted;
+        });
+
+        Run("repair" + prefix, cueCount, 0, [&]()
+        {
+            g_sink = g_sink + (long)srtFile.RepairTimings(SrtOverlapPolicy::TrimPrevious, 40);
+        });
+
+        std::vector<char> output(srtFile.ComputeSerializedSize());
+        Run("write" + prefix, cueCount, output.size(), [&]()
+        {
+            g_sink = g_sink + (long)srtFile.WriteToBuffer(output.data(), output.size());
+        });
+
+        std::vector<char> cleanOutput(srtFile.ComputeSerializedSize(true));
+        Run("write_cleanup" + prefix, cueCount, cleanOutput.size(), [&]()
+        {
+            g_sink = g_sink + (long)srtFile.WriteToBuffer(cleanOutput.data(), cleanOutput.size(), true);
+        });
+
+        std::string outputText;
+        Run("write_string" + prefix, cueCount, output.size(), [&]()
+        {
+            srtFile.WriteToString(outputText);
+        }, [&]()
+        {
+            outputText = std::string();
+        });
+
+        std::string patchedText = text;
+        SrtFile patchedFile;
+        patchedFile.SetRecordTimings(true);
+        patchedFile.ReadFromBuffer(patchedText);
+        Run("patch" + prefix, cueCount, cueCount * 24, [&]()
+        {
+            g_sink = g_sink + patchedFile.PatchTimings(patchedText.data(), patchedText.size());
+        });
+
+        SrtTimeIndex timeIndex;
+        Run("time_index" + prefix, cueCount, 0, [&]()
+        {
+            timeIndex.Build(srtFile.m_subtitles);
+        });
+
+        // Times spread over the whole file, like seeking during playback
+        const size_t queryCount = 10000;
+        const long duration = srtFile.m_subtitles.back().m_endTime.GetMilliseconds();
+        std::vector<size_t> found;
+        srtFile.GetTimeIndex();
+        Run("find_at" + prefix, queryCount, 0, [&]()
+        {
+            size_t foundCount = 0;
+            for (size_t query = 0; query < queryCount; query++)
+            {
+                srtFile.FindSubtitlesAt((long)((uint64_t)query * 2654435761u % (uint64_t)duration), found);
+                foundCount += found.size();
+            }
+            g_sink = g_sink + (long)foundCount;
+        });
+    }
+
+    const char* GetSimdName()
+    {
+#if defined(SRTFILE_SIMD_AVX2)
+        return "avx2";
+#elif defined(SRTFILE_SIMD_SSE2)
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    void PrintJson()
+    {
+        char date[32];
+        const time_t now = time(nullptr);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+        printf("{\n");
+        printf("  \"context\": {\n");
+        printf("    \"date\": \"%s\",\n", date);
+        printf("    \"library\": \"SrtFile\",\n");
+        printf("    \"simd\": \"%s\",\n", GetSimdName());
+        printf("    \"num_cpus\": %u\n", std::thread::hardware_concurrency());
+        printf("  },\n");
+        printf("  \"benchmarks\": [\n");
+        for (size_t i = 0; i < g_results.size(); i++)
+        {
+            const Result& result = g_results[i];
+            const double seconds = result.m_ns * 1e-9;
+            printf("    {\n");
+            printf("      \"name\": \"%s\",\n", result.m_name.c_str());
+            printf("      \"iterations\": %d,\n", result.m_iterations);
+            printf("      \"real_time\": %.1f,\n", result.m_ns);
+            printf("      \"time_unit\": \"ns\",\n");
+            printf("      \"items_per_second\": %.1f,\n", result.m_itemCount / seconds);
+            printf("      \"bytes_per_second\": %.1f\n", result.m_byteCount / seconds);
+            printf("    }%s\n", i + 1 < g_results.size() ? "," : "");
+        }
+        printf("  ]\n");
+        printf("}\n");
+    }
+
+    bool ParseSettings(int argc, char* argv[])
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+            if (arg == "--json")
+                g_settings.m_json = true;
+            else if (arg == "--filter" && i + 1 < argc)
+                g_settings.m_filter = argv[++i];
+            else if (arg == "--max-cues" && i + 1 < argc)
+                g_settings.m_maxCueCount = strtoul(argv[++i], nullptr, 10);
+            else
+                return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (!ParseSettings(argc, argv))
+    {
+        fprintf(stderr, "Usage: srtbenchmark [--json] [--filter <text>] [--max-cues <count>]\n");
+        return 2;
+    }
+
+    BenchmarkTimeCodes();
+
+    for (size_t cueCount : { 1000, 100000, 1000000 })
+    {
+        if (cueCount > g_settings.m_maxCueCount)
+            continue;
+
+        SrtCorpusOptions options;
+        options.m_seed = 12345;
+        options.m_cueCount = cueCount;
+        options.m_lineWeights = { 1, 1 };
+
+        SrtCorpusOptions crlfOptions = options;
+        crlfOptions.m_crlf = true;
+
+        SrtCorpusOptions longOptions = options;
+        longOptions.m_lineLength = 120;
+
+        SrtCorpusOptions messyOptions = crlfOptions;
+        messyOptions.m_utf8Ratio = 0.2;
+        messyOptions.m_coordinatesRatio = 0.05;
+        messyOptions.m_overlapRatio = 0.02;
+        messyOptions.m_junkRatio = 0.25;
+        messyOptions.m_malformedRatio = 0.01;
+
+        const Corpus corpora[] =
+        {
+            { "lf", options },
+            { "crlf", crlfOptions },
+            { "long", longOptions },
+            { "messy", messyOptions },
+        };
+        for (const Corpus& corpus : corpora)
+            BenchmarkCorpus(corpus);
+    }
+
+    if (g_settings.m_json)
+        PrintJson();
+    return 0;
+}
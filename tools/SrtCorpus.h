@@ -0,0 +1,224 @@
+// ----------------------------------------------------------------------------
+// SrtCorpus.h
+// Synthetic SRT file generator, for benchmarks and stress tests.
+//
+// The same options and seed always give the same file, on all systems.
+// Besides regular subtitles, the generator can add what real files contain:
+// multilingual UTF-8 text, coordinates after the timecodes, overlapping
+// times, junk lines between subtitles, and malformed blocks.
+//
+// The output is written as it is generated, so files of any size can be
+// produced with constant memory.
+//
+// The text samples are UTF-8, so MSVC needs the /utf-8 option.
+//
+// Usage example:
+//
+//  SrtCorpusOptions options;
+//  options.m_cueCount = 100000;
+//  options.m_malformedRatio = 0.01;
+//  std::string text = SrtCorpusGenerator(options).GenerateString();
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "SrtFile.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct SrtCorpusOptions
+{
+    uint64_t m_seed = 1;
+    size_t m_cueCount = 1000;
+    std::vector<unsigned> m_lineWeights = { 60, 35, 5 };   // Relative weights of subtitles with 1, 2, 3... text lines
+    size_t m_lineLength = 32;           // Average bytes per text line
+    double m_utf8Ratio = 0.0;           // Part of the text lines in languages other than English
+    double m_coordinatesRatio = 0.0;    // Part of the timing lines followed by coordinates
+    double m_overlapRatio = 0.0;        // Part of the subtitles starting before the previous one ends
+    double m_junkRatio = 0.0;           // Part of the subtitles preceded by junk extra lines
+    double m_malformedRatio = 0.0;      // Part of the subtitles with a malformed block
+    bool m_crlf = false;
+};
+
+class SrtCorpusGenerator
+{
+public:
+    SrtCorpusGenerator(const SrtCorpusOptions& options) : m_options(options), m_state(options.m_seed)
+    {
+        for (unsigned weight : m_options.m_lineWeights)
+            m_totalLineWeight += weight;
+    }
+
+    // Writes the whole file to any of the SrtFileInternal outputs.
+    template <typename Output>
+    void Generate(Output& output)
+    {
+        const std::string_view newline = m_options.m_crlf ? "\r\n" : "\n";
+        long time = 1000;
+        long previousEnd = 0;
+
+        for (size_t cue = 0; cue < m_options.m_cueCount; cue++)
+        {
+            if (Chance(m_options.m_junkRatio))
+                WriteJunk(output, newline);
+
+            const long duration = 800 + (long)Next(4000);
+            if (cue > 0 && Chance(m_options.m_overlapRatio))
+                time = std::max(previousEnd - duration / 2 - 1, 0L);
+
+            const unsigned malformedKind = Chance(m_options.m_malformedRatio) ? 1 + Next(MalformedKindCount) : 0;
+            WriteSubtitle(output, newline, (long)cue + 1, time, time + duration, malformedKind);
+            output.FlushIfFull();
+
+            previousEnd = time + duration;
+            time = previousEnd + (long)Next(1000);
+
+            // Timecodes have two hour digits, so very large files restart from the beginning,
+            // like files made by joining many others
+            if (time > MaxTime)
+            {
+                time = 1000;
+                previousEnd = 0;
+            }
+        }
+    }
+
+    std::string GenerateString()
+    {
+        SrtFileInternal::OutputBuffer output;
+        Generate(output);
+        return std::move(output.GetText());
+    }
+
+private:
+    static constexpr unsigned MalformedKindCount = 6;
+    static constexpr long MaxTime = 99L * 3600 * 1000;
+
+    // SplitMix64, fast and the same on all systems, unlike the standard distributions.
+    uint64_t NextRandom()
+    {
+        uint64_t value = (m_state += 0x9E3779B97F4A7C15ull);
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
+
+    unsigned Next(unsigned count)
+    {
+        return (unsigned)(NextRandom() % count);
+    }
+
+    bool Chance(double ratio)
+    {
+        return ratio > 0.0 && (double)(NextRandom() >> 11) * (1.0 / 9007199254740992.0) < ratio;
+    }
+
+    size_t NextLineCount()
+    {
+        if (m_totalLineWeight == 0)
+            return 1;
+        unsigned weight = Next(m_totalLineWeight);
+        for (size_t i = 0; i < m_options.m_lineWeights.size(); i++)
+        {
+            if (weight < m_options.m_lineWeights[i])
+                return i + 1;
+            weight -= m_options.m_lineWeights[i];
+        }
+        return m_options.m_lineWeights.size();
+    }
+
+    template <typename Output>
+    void WriteSubtitle(Output& output, std::string_view newline, long index, long startTime, long endTime, unsigned malformedKind)
+    {
+        // Kinds of malformed blocks, each exercising a different recovery path of the parser
+        enum { None, BadTimecode, NoIndex, NoTiming, NegativeIndex, EndBeforeStart, NoBlankLine };
+
+        if (malformedKind != NoIndex)
+        {
+            if (malformedKind == NegativeIndex)
+                output.Append('-');
+            output.AppendNumber(index);
+            output.Append(newline);
+        }
+
+        if (malformedKind != NoTiming)
+        {
+            if (malformedKind == EndBeforeStart)
+                std::swap(startTime, endTime);
+            output.AppendTimeCode(startTime);
+            output.Append(" --> ");
+            if (malformedKind == BadTimecode)
+                output.Append("00:0x:12,5o0");
+            else
+                output.AppendTimeCode(endTime);
+
+            if (Chance(m_options.m_coordinatesRatio))
+            {
+                output.Append(" X1:");
+                output.AppendNumber(40 + (long)Next(200));
+                output.Append(" X2:");
+                output.AppendNumber(400 + (long)Next(300));
+                output.Append(" Y1:");
+                output.AppendNumber(20 + (long)Next(400));
+                output.Append(" Y2:");
+                output.AppendNumber(440 + (long)Next(100));
+            }
+            output.Append(newline);
+        }
+
+        const size_t lineCount = NextLineCount();
+        for (size_t line = 0; line < lineCount; line++)
+        {
+            WriteTextLine(output);
+            output.Append(newline);
+        }
+
+        if (malformedKind != NoBlankLine)
+            output.Append(newline);
+    }
+
+    template <typename Output>
+    void WriteTextLine(Output& output)
+    {
+        static const std::string_view englishWords[] = { "the", "subtitle", "is", "shown", "here", "with", "some",
+            "words", "and", "a", "longer", "sentence", "for", "timing", "tests", "ok", "<i>really</i>", "you?" };
+        static const std::string_view otherWords[] = { "déjà", "très", "garçon", "où", "Straße", "über", "Größe",
+            "привет", "спасибо", "мир", "こんにちは", "字幕", "世界", "你好", "电影", "مرحبا", "عالم", "καλημέρα",
+            "שלום", "안녕하세요", "🎬", "¿qué?" };
+
+        const bool english = !Chance(m_options.m_utf8Ratio);
+        const std::string_view* words = english ? englishWords : otherWords;
+        const unsigned wordCount = english ? (unsigned)std::size(englishWords) : (unsigned)std::size(otherWords);
+
+        const size_t length = m_options.m_lineLength / 2 + Next((unsigned)m_options.m_lineLength + 1);
+        size_t lineLength = 0;
+        while (lineLength < length)
+        {
+            const std::string_view word = words[Next(wordCount)];
+            if (lineLength > 0)
+                output.Append(' ');
+            output.Append(word);
+            lineLength += word.size() + 1;
+        }
+    }
+
+    template <typename Output>
+    void WriteJunk(Output& output, std::string_view newline)
+    {
+        static const std::string_view junkLines[] = { "NOTE extra text", "www.example.com subtitles", "{\\an8}",
+            "42", "00:00:01,000", "--> broken arrow", " \t ", "<font color=\"#ffff00\">" };
+
+        const unsigned lineCount = 1 + Next(2);
+        for (unsigned line = 0; line < lineCount; line++)
+        {
+            output.Append(junkLines[Next((unsigned)std::size(junkLines))]);
+            output.Append(newline);
+        }
+        output.Append(newline);
+    }
+
+    SrtCorpusOptions m_options;
+    uint64_t m_state;
+    unsigned m_totalLineWeight = 0;
+};
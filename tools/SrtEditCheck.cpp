@@ -0,0 +1,483 @@
+// ----------------------------------------------------------------------------
+// SrtEditCheck.cpp
+// Checks the plugin's incremental subtitle index against full parses.
+//
+// A generated file is opened in MockScintilla, then edited at random the
+// way typing, pasting and deleting would. After each edit, the cue index of
+// the document cache is updated and compared with the subtitles SrtFile
+// finds in the whole document. Operations are also applied to random
+// selections: each subtitle is compared with the expected result, the rest
+// of the text must be left untouched, and a single undo must revert it all.
+//
+// Usage: srteditcheck [--cues <count>] [--edits <count>] [--seed <number>] [--messy]
+//        srteditcheck --regressions
+//
+// --regressions repeats the runs that found bugs before, listed in RegressionRuns,
+// to run after changing the editing code. It also checks how SrtFile reads the
+// malformed index lines listed in ParseCases.
+//
+// Build:
+//  g++ -O2 -std=c++17 -I../source SrtEditCheck.cpp -o srteditcheck
+//  cl /O2 /EHsc /std:c++17 /utf-8 /I..\source SrtEditCheck.cpp
+// ----------------------------------------------------------------------------
+
+#include "MockScintilla.h"
+#include "SrtCorpus.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Settings
+    {
+        SrtCorpusOptions m_corpus;
+        size_t m_editCount = 5000;
+        size_t m_operationInterval = 50;
+    };
+
+    double GetSeconds(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Positions of the subtitles SrtFile finds in the whole text.
+    std::vector<SrtCueIndex::Cue> FindCues(const SrtFile& srtFile, std::string_view text)
+    {
+        std::vector<SrtCueIndex::Cue> cues;
+        for (const SrtSubtitle& subtitle : srtFile.m_subtitles)
+        {
+            const size_t start = (size_t)(subtitle.m_extra.data() - text.data());
+            cues.push_back({ start, start + subtitle.m_extra.size() });
+        }
+        return cues;
+    }
+
+    bool HasStandardLines(const SrtSubtitle& subtitle, std::string_view text)
+    {
+        char line[80];
+        std::string expected(line, SrtFileInternal::FormatNumber(line, subtitle.m_index));
+        expected += '\n';
+        expected.append(line, SrtFileInternal::FormatTimeCode(line, subtitle.m_startTime.GetMilliseconds()));
+        expected += " --> ";
+        expected.append(line, SrtFileInternal::FormatTimeCode(line, subtitle.m_endTime.GetMilliseconds()));
+        if (!subtitle.m_coordinates.empty())
+            expected += ' ' + std::string(subtitle.m_coordinates);
+
+        // Line endings are kept as they are, and so is the space after coordinates ending with a carriage return
+        while (!expected.empty() && (expected.back() == '\r' || expected.back() == ' '))
+            expected.pop_back();
+        std::string_view rest = text.substr((size_t)(subtitle.m_extra.data() + subtitle.m_extra.size() - text.data()));
+        std::string found;
+        for (int line = 0; line < 2; line++)
+        {
+            std::string_view foundLine = rest.substr(0, rest.find('\n'));
+            rest.remove_prefix(std::min(foundLine.size() + 1, rest.size()));
+            while (!foundLine.empty() && (foundLine.back() == '\r' || (line > 0 && foundLine.back() == ' ')))
+                foundLine.remove_suffix(1);
+            found += line > 0 ? "\n" : "";
+            found += foundLine;
+        }
+        return found == expected;
+    }
+
+    bool CheckIndex(const SrtCueIndex& cueIndex, std::string_view text, const char* context)
+    {
+        const SrtFile srtFile(text);
+        const std::vector<SrtCueIndex::Cue> cues = FindCues(srtFile, text);
+        if (cueIndex.GetCueCount() != cues.size())
+        {
+            fprintf(stderr, "%s: index has %zu subtitles instead of %zu\n", context, cueIndex.GetCueCount(), cues.size());
+            return false;
+        }
+
+        for (size_t cue = 0; cue < cues.size(); cue++)
+        {
+            const SrtCueIndex::Cue found = cueIndex.GetCue(cue);
+            if (found.m_start != cues[cue].m_start || found.m_indexStart != cues[cue].m_indexStart)
+            {
+                fprintf(stderr, "%s: subtitle %zu at %zu/%zu instead of %zu/%zu\n", context, cue,
+                    found.m_start, found.m_indexStart, cues[cue].m_start, cues[cue].m_indexStart);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    class EditChecker
+    {
+    public:
+        EditChecker(const Settings& settings) : m_settings(settings), m_random(settings.m_corpus.m_seed),
+            m_editor(SrtCorpusGenerator(settings.m_corpus).GenerateString())
+        {
+            m_editor.SetNotify([this](const SCNotification& notification)
+            {
+                m_documentCache.OnModified(DocumentId, m_editor.GetCaller(), notification);
+            });
+        }
+
+        bool Run()
+        {
+            Clock::time_point start = Clock::now();
+            m_documentCache.UpdateIndex(DocumentId, m_editor.GetCaller());
+            const double buildSeconds = GetSeconds(start);
+            if (!CheckIndex(GetIndex(), m_editor.GetText(), "build"))
+                return false;
+
+            double updateSeconds = 0.0;
+            size_t operationCount = 0;
+            for (size_t edit = 1; edit <= m_settings.m_editCount; edit++)
+            {
+                MakeRandomEdit();
+
+                start = Clock::now();
+                m_documentCache.UpdateIndex(DocumentId, m_editor.GetCaller());
+                updateSeconds += GetSeconds(start);
+
+                const std::string context = "edit " + std::to_string(edit);
+                if (!CheckIndex(GetIndex(), m_editor.GetText(), context.c_str()))
+                    return false;
+
+                if (edit % m_settings.m_operationInterval == 0)
+                {
+                    if (!ApplyRandomOperations(context.c_str()))
+                        return false;
+                    operationCount++;
+                }
+            }
+
+            printf("%zu edits and %zu operations on %zu subtitles, %.1f KB: ok\n", m_settings.m_editCount, operationCount,
+                GetIndex().GetCueCount(), m_editor.GetLength() / 1024.0);
+            printf("full parse %.3f ms, update after an edit %.3f ms on average\n", buildSeconds * 1000.0,
+                m_settings.m_editCount > 0 ? updateSeconds * 1000.0 / m_settings.m_editCount : 0.0);
+            return true;
+        }
+
+    private:
+        static constexpr uptr_t DocumentId = 1;
+
+        const SrtCueIndex& GetIndex()
+        {
+            return m_documentCache.UpdateIndex(DocumentId, m_editor.GetCaller());
+        }
+
+        size_t Next(size_t count)
+        {
+            return count > 0 ? (size_t)(m_random() % count) : 0;
+        }
+
+        // Edits are mostly close to the previous one, like typing.
+        size_t NextPosition()
+        {
+            const size_t length = m_editor.GetLength();
+            if (Next(10) < 7)
+                m_position = std::min(m_position + Next(40), length);
+            else
+                m_position = Next(length + 1);
+            return m_position;
+        }
+
+        void MakeRandomEdit()
+        {
+            static const std::string_view snippets[] = { "a", " ", "\n", "\r\n", "\n\n", "12\n", "-3\n", "00:01",
+                " --> ", "00:00:01,000 --> 00:00:02,500\n", "\n7\n00:10:00,000 --> 00:10:01,000\nNew text\n\n" };
+
+            const size_t position = NextPosition();
+            const size_t remaining = m_editor.GetLength() - position;
+            const size_t kind = Next(20);
+            if (kind < 9)
+            {
+                m_editor.InsertText(position, snippets[Next(std::size(snippets))]);
+            }
+            else if (kind < 16)
+            {
+                m_editor.DeleteText(position, std::min(1 + Next(8), remaining));
+            }
+            else if (kind < 18)
+            {
+                m_editor.DeleteText(position, std::min(1 + Next(400), remaining));
+            }
+            else
+            {
+                // Paste a part of the document somewhere else
+                const std::string_view text = m_editor.GetText();
+                const size_t copyStart = Next(text.size());
+                const std::string copy(text.substr(copyStart, 1 + Next(300)));
+                m_editor.InsertText(position, copy);
+            }
+        }
+
+        bool ApplyRandomOperations(const char* context)
+        {
+            SrtStreamOperations operations;
+            operations.m_timeOffset = (long)Next(120001) - 60000;
+            operations.m_startIndex = Next(2) ? (long)Next(100) + 1 : 0;
+            operations.m_removeExtra = Next(4) == 0;
+
+            const size_t length = m_editor.GetLength();
+            if (Next(2))
+                m_editor.SetSelection(0, 0);
+            else
+                m_editor.SetSelection(Next(length + 1), Next(length + 1));
+
+            // Expected result, from the operations applied to each subtitle
+            const std::string oldText(m_editor.GetText());
+            const SrtFile oldFile(oldText);
+            const std::vector<SrtCueIndex::Cue> oldCues = FindCues(oldFile, oldText);
+            const size_t selectionStart = m_editor.GetSelectionStart();
+            const size_t selectionEnd = m_editor.GetSelectionEnd();
+            size_t firstCue = 0;
+            size_t endCue = oldCues.size();
+            if (selectionStart != selectionEnd)
+            {
+                while (firstCue < oldCues.size() && oldCues[firstCue].m_indexStart < selectionStart)
+                    firstCue++;
+                endCue = firstCue;
+                while (endCue < oldCues.size() && oldCues[endCue].m_indexStart < selectionEnd)
+                    endCue++;
+            }
+
+            long offset = operations.m_timeOffset;
+            if (firstCue < endCue && offset < 0)
+                offset = -std::min(oldFile.m_subtitles[firstCue].m_startTime.GetMilliseconds(), -offset);
+
+            const size_t undoActionCount = m_editor.GetUndoActionCount();
+            const size_t writtenCount = m_documentCache.ApplyOperations(DocumentId, m_editor.GetCaller(), operations);
+            if (writtenCount != endCue - firstCue)
+            {
+                fprintf(stderr, "%s: operations wrote %zu subtitles instead of %zu\n", context, writtenCount, endCue - firstCue);
+                return false;
+            }
+
+            const std::string_view newText = m_editor.GetText();
+            const size_t expectedUndoActionCount = undoActionCount + (newText != oldText);
+            if (m_editor.IsInUndoAction() || m_editor.GetUndoActionCount() != expectedUndoActionCount)
+            {
+                fprintf(stderr, "%s: operations made %zu undo actions\n", context, m_editor.GetUndoActionCount() - undoActionCount);
+                return false;
+            }
+
+            const SrtFile newFile(newText);
+            if (newFile.m_subtitles.size() != oldFile.m_subtitles.size())
+            {
+                fprintf(stderr, "%s: %zu subtitles after the operations instead of %zu\n", context,
+                    newFile.m_subtitles.size(), oldFile.m_subtitles.size());
+                return false;
+            }
+
+            // Only numbers, timecodes and removed extra text can change, everything else is kept as is
+            auto FirstLine = [](std::string_view text) { return text.substr(0, std::min(text.find('\n'), text.size() - 1) + 1); };
+            for (size_t cue = 0; cue < oldFile.m_subtitles.size(); cue++)
+            {
+                SrtSubtitle expected = oldFile.m_subtitles[cue];
+                const SrtSubtitle& found = newFile.m_subtitles[cue];
+                if (cue >= firstCue && cue < endCue)
+                {
+                    expected.OffsetInMilliseconds(offset);
+                    if (operations.m_startIndex > 0)
+                        expected.SetIndex(operations.m_startIndex + (long)(cue - firstCue));
+                    if (operations.m_removeExtra)
+                        expected.m_extra = cue > 0 ? FirstLine(expected.m_extra) : std::string_view();
+                }
+
+                if (found.m_index != expected.m_index || found.m_startTime.GetMilliseconds() != expected.m_startTime.GetMilliseconds()
+                    || found.m_endTime.GetMilliseconds() != expected.m_endTime.GetMilliseconds() || found.m_coordinates != expected.m_coordinates
+                    || found.m_text != expected.m_text || found.m_extra != expected.m_extra)
+                {
+                    fprintf(stderr, "%s: subtitle %zu is wrong after the operations\n", context, cue);
+                    return false;
+                }
+
+                // Removing extra text also rewrites index and timing lines in the standard form
+                if (operations.m_removeExtra && cue >= firstCue && cue < endCue && !HasStandardLines(found, newText))
+                {
+                    fprintf(stderr, "%s: subtitle %zu isn't in the standard form after the operations\n", context, cue);
+                    return false;
+                }
+            }
+
+            // Nothing is changed when the selection holds no subtitle
+            const bool removedTrailingExtra = operations.m_removeExtra && firstCue < endCue && endCue == oldCues.size() &&
+                (selectionStart == selectionEnd || selectionEnd > oldText.size() - oldFile.m_extra.size());
+            const std::string_view expectedExtra = removedTrailingExtra ? FirstLine(oldFile.m_extra) : oldFile.m_extra;
+            if (newFile.m_extra != expectedExtra)
+            {
+                fprintf(stderr, "%s: the text after the last subtitle is wrong after the operations\n", context);
+                return false;
+            }
+
+            const std::string operationContext = std::string(context) + ", after the operations";
+            if (!CheckIndex(GetIndex(), newText, operationContext.c_str()))
+                return false;
+
+            // A single undo reverts all the changes
+            if (newText != oldText && Next(4) == 0)
+            {
+                m_editor.Undo();
+                if (m_editor.GetText() != oldText)
+                {
+                    fprintf(stderr, "%s: undo didn't revert the operations\n", context);
+                    return false;
+                }
+
+                const std::string undoContext = std::string(context) + ", after undo";
+                return CheckIndex(GetIndex(), m_editor.GetText(), undoContext.c_str());
+            }
+            return true;
+        }
+
+        Settings m_settings;
+        std::mt19937_64 m_random;
+        MockScintilla m_editor;
+        SrtDocumentCache m_documentCache;
+        size_t m_position = 0;
+    };
+
+    // Runs that found bugs before, as messy corpus, cue count, edit count and seed
+    struct RegressionRun
+    {
+        bool m_messy;
+        size_t m_cueCount;
+        size_t m_editCount;
+        size_t m_seed;
+    };
+
+    const RegressionRun RegressionRuns[] =
+    {
+        { true, 3000, 8000, 4 },    // Index line with text after the number
+        { true, 3000, 8000, 5 },
+        { true, 300, 3000, 11 },    // Cleanup with a selection holding no subtitle
+    };
+
+    // Texts with malformed index lines, and the indexes of the subtitles read from them.
+    // Lines that are not indexes are kept as extra text, so the text must be written back unchanged.
+    struct ParseCase
+    {
+        const char* m_text;
+        std::vector<long> m_indexes;
+    };
+
+    const ParseCase ParseCases[] =
+    {
+        // A negative index is not an index: the cue is kept as extra text, and reading goes on
+        { "-3\n00:00:01,000 --> 00:00:02,000\nA\n", {} },
+        { "1\n00:00:01,000 --> 00:00:02,000\nA\n\n-2\n00:00:03,000 --> 00:00:04,000\nB\n\n3\n00:00:05,000 --> 00:00:06,000\nC\n", { 1, 3 } },
+        // Numbers too large for a long are not indexes
+        { "99999999999999999999999\n00:00:01,000 --> 00:00:02,000\nA\n", {} },
+    };
+
+    bool CheckParseCases()
+    {
+        for (const ParseCase& parseCase : ParseCases)
+        {
+            SrtFile srtFile(std::string_view(parseCase.m_text));
+            std::vector<long> indexes;
+            for (const SrtSubtitle& subtitle : srtFile.m_subtitles)
+                indexes.push_back(subtitle.m_index);
+
+            std::string text;
+            srtFile.WriteToString(text);
+            if (!srtFile.IsValid())
+                text = std::string(srtFile.m_extra);
+
+            if (indexes != parseCase.m_indexes || text != parseCase.m_text)
+            {
+                printf("FAILED: reading %s\n", parseCase.m_text);
+                return false;
+            }
+        }
+        printf("%zu parse cases: ok\n", std::size(ParseCases));
+        return true;
+    }
+
+    void SetMessy(Settings& settings)
+    {
+        settings.m_corpus.m_crlf = true;
+        settings.m_corpus.m_utf8Ratio = 0.2;
+        settings.m_corpus.m_coordinatesRatio = 0.05;
+        settings.m_corpus.m_overlapRatio = 0.02;
+        settings.m_corpus.m_junkRatio = 0.25;
+    }
+
+    bool RunRegressions()
+    {
+        if (!CheckParseCases())
+            return false;
+
+        for (const RegressionRun& run : RegressionRuns)
+        {
+            Settings settings;
+            if (run.m_messy)
+                SetMessy(settings);
+            settings.m_corpus.m_cueCount = run.m_cueCount;
+            settings.m_editCount = run.m_editCount;
+            settings.m_corpus.m_seed = run.m_seed;
+
+            printf("--cues %zu --edits %zu --seed %zu%s\n", run.m_cueCount, run.m_editCount, run.m_seed, run.m_messy ? " --messy" : "");
+            EditChecker checker(settings);
+            if (!checker.Run())
+                return false;
+        }
+        return true;
+    }
+
+    bool ParseCount(const char* text, size_t& count)
+    {
+        char* end = nullptr;
+        count = (size_t)strtoull(text, &end, 10);
+        return end != text && *end == '\0' && text[0] != '-';
+    }
+
+    bool ParseOptions(int argc, char* argv[], Settings& settings)
+    {
+        settings.m_corpus.m_cueCount = 2000;
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+            const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+            size_t count = 0;
+
+            if (arg == "--messy")
+            {
+                SetMessy(settings);
+                continue;
+            }
+            if (value == nullptr || !ParseCount(value, count))
+                return false;
+
+            if (arg == "--cues")
+                settings.m_corpus.m_cueCount = count;
+            else if (arg == "--edits")
+                settings.m_editCount = count;
+            else if (arg == "--seed")
+                settings.m_corpus.m_seed = count;
+            else
+                return false;
+            i++;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 2 && std::string(argv[1]) == "--regressions")
+        return RunRegressions() ? 0 : 1;
+
+    Settings settings;
+    if (!ParseOptions(argc, argv, settings))
+    {
+        fprintf(stderr, "Usage: srteditcheck [--cues <count>] [--edits <count>] [--seed <number>] [--messy]\n");
+        fprintf(stderr, "       srteditcheck --regressions\n");
+        return 2;
+    }
+
+    EditChecker checker(settings);
+    return checker.Run() ? 0 : 1;
+}
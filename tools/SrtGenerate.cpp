@@ -0,0 +1,193 @@
+// ----------------------------------------------------------------------------
+// SrtGenerate.cpp
+// Generates synthetic SRT files for benchmarks and stress tests.
+//
+// The same options always give the same file, so large test inputs can be
+// recreated anywhere instead of being stored.
+//
+// Build:
+//  g++ -O2 -std=c++17 -I../source SrtGenerate.cpp -o srtgenerate
+//  cl /O2 /EHsc /std:c++17 /utf-8 /I..\source SrtGenerate.cpp
+// ----------------------------------------------------------------------------
+
+#include "SrtCorpus.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#if defined(_WIN32)
+    #include <fcntl.h>
+    #include <io.h>
+#endif
+
+namespace
+{
+    void PrintUsage()
+    {
+        fprintf(stderr,
+            "Usage: srtgenerate [options]\n"
+            "\n"
+            "Options:\n"
+            "  -o, --output <file>     Write to the given file instead of the standard output\n"
+            "  -n, --cues <count>      Number of subtitles (default 1000)\n"
+            "  -s, --seed <number>     Random seed (default 1)\n"
+            "  --lines <w1,w2,...>     Weights of subtitles with 1, 2... text lines (default 60,35,5)\n"
+            "  --line-length <bytes>   Average length of the text lines (default 32)\n"
+            "  --utf8 <ratio>          Part of the text lines in other languages than English\n"
+            "  --coordinates <ratio>   Part of the timing lines with X1/X2/Y1/Y2 coordinates\n"
+            "  --overlap <ratio>       Part of the subtitles overlapping the previous one\n"
+            "  --junk <ratio>          Part of the subtitles preceded by junk lines\n"
+            "  --malformed <ratio>     Part of the subtitles with a malformed block\n"
+            "  --crlf                  Use CRLF line endings\n"
+            "  --messy                 Shortcut for typical ratios of all the defects above\n");
+    }
+
+    bool ParseRatio(const char* text, double& ratio)
+    {
+        char* end = nullptr;
+        ratio = strtod(text, &end);
+        return end != text && *end == '\0' && ratio >= 0.0 && ratio <= 1.0;
+    }
+
+    bool ParseCount(const char* text, unsigned long long& count)
+    {
+        char* end = nullptr;
+        count = strtoull(text, &end, 10);
+        return end != text && *end == '\0' && text[0] != '-';
+    }
+
+    bool ParseWeights(const std::string& text, std::vector<unsigned>& weights)
+    {
+        weights.clear();
+        size_t pos = 0;
+        while (pos <= text.size())
+        {
+            size_t end = std::min(text.find(',', pos), text.size());
+            unsigned long long weight;
+            if (!ParseCount(text.substr(pos, end - pos).c_str(), weight))
+                return false;
+            weights.push_back((unsigned)weight);
+            pos = end + 1;
+        }
+        return !weights.empty();
+    }
+
+    bool ParseOptions(int argc, char* argv[], SrtCorpusOptions& options, std::string& outputPath)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+            const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+            unsigned long long count = 0;
+            bool valid = value != nullptr;
+
+            if (arg == "--crlf")
+            {
+                options.m_crlf = true;
+                continue;
+            }
+            if (arg == "--messy")
+            {
+                options.m_utf8Ratio = 0.2;
+                options.m_coordinatesRatio = 0.05;
+                options.m_overlapRatio = 0.02;
+                options.m_junkRatio = 0.05;
+                options.m_malformedRatio = 0.01;
+                continue;
+            }
+            if (!valid)
+                return false;
+
+            if (arg == "-o" || arg == "--output")
+            {
+                outputPath = value;
+            }
+            else if (arg == "-n" || arg == "--cues")
+            {
+                valid = ParseCount(value, count);
+                options.m_cueCount = (size_t)count;
+            }
+            else if (arg == "-s" || arg == "--seed")
+            {
+                valid = ParseCount(value, count);
+                options.m_seed = count;
+            }
+            else if (arg == "--lines")
+            {
+                valid = ParseWeights(value, options.m_lineWeights);
+            }
+            else if (arg == "--line-length")
+            {
+                valid = ParseCount(value, count) && count > 0;
+                options.m_lineLength = (size_t)count;
+            }
+            else if (arg == "--utf8")
+            {
+                valid = ParseRatio(value, options.m_utf8Ratio);
+            }
+            else if (arg == "--coordinates")
+            {
+                valid = ParseRatio(value, options.m_coordinatesRatio);
+            }
+            else if (arg == "--overlap")
+            {
+                valid = ParseRatio(value, options.m_overlapRatio);
+            }
+            else if (arg == "--junk")
+            {
+                valid = ParseRatio(value, options.m_junkRatio);
+            }
+            else if (arg == "--malformed")
+            {
+                valid = ParseRatio(value, options.m_malformedRatio);
+            }
+            else
+            {
+                valid = false;
+            }
+
+            if (!valid)
+                return false;
+            i++;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    SrtCorpusOptions options;
+    std::string outputPath;
+    if (!ParseOptions(argc, argv, options, outputPath))
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    std::ofstream outputFile;
+    if (!outputPath.empty())
+    {
+        outputFile.open(outputPath, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        if (!outputFile)
+        {
+            fprintf(stderr, "srtgenerate: cannot write %s\n", outputPath.c_str());
+            return 1;
+        }
+    }
+    else
+    {
+        std::ios::sync_with_stdio(false);
+#if defined(_WIN32)
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    }
+
+    std::ostream& stream = outputFile.is_open() ? outputFile : std::cout;
+    {
+        SrtFileInternal::OutputBuffer output(stream);
+        SrtCorpusGenerator(options).Generate(output);
+    }
+    stream.flush();
+    return stream.good() ? 0 : 1;
+}
@@ -0,0 +1,681 @@
+// ----------------------------------------------------------------------------
+// SrtTool.cpp
+// Command line version of the SrtTools plugin operations.
+//
+// Applies the same time offset, renumbering and cleanup as the plugin panel,
+// to any number of files, or from the standard input to the standard output.
+// Files that drift from their video are resynced from anchor times, each
+// moved to a new time, with the times in between moved in proportion.
+// Times can also be converted between frame rates, such as 23.976 and 25,
+// and overlapping subtitles fixed after sorting them by start time.
+// The timing changes and renumbering can be limited to the subtitles
+// starting in a range of times, found by binary search.
+// Files are mapped in memory and written with a single write each.
+// The standard input is processed one subtitle at a time, unless overlaps
+// are fixed, which needs all the subtitles.
+//
+// Large batches, given as a list of files or a directory tree, are spread
+// over several threads. Each thread reuses its parse and output buffers
+// from one file to the next, and results are written to a temporary file
+// then renamed, so a file is never left half written.
+//
+// With --patch, files that only have their times changed in place get the
+// digits of their timecodes rewritten directly in the mapped file, which is
+// much faster on large files but can leave a file half shifted if the
+// process is killed.
+//
+// Build:
+//  g++ -O2 -std=c++17 -I../source SrtTool.cpp -o srttool -pthread
+//  cl /O2 /EHsc /std:c++17 /I..\source SrtTool.cpp
+// Add -DSRTFILE_STATS (or /DSRTFILE_STATS) to also show the parser and writer
+// counters with --stats.
+// ----------------------------------------------------------------------------
+
+#include "SrtStream.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <fcntl.h>
+    #include <io.h>
+#endif
+
+namespace
+{
+    struct InputFile
+    {
+        std::string m_path;
+        std::string m_name;     // Relative path of the result in the output directory
+        bool m_sameName = false;    // Another file before this one has the same result path
+    };
+
+    struct Options
+    {
+        SrtStreamOperations m_operations;
+        bool m_inPlace = false;
+        bool m_patch = false;
+        std::string m_outputDir;
+        unsigned m_threadCount = 1;
+        unsigned m_jobCount = 1;
+        bool m_showStats = false;
+        bool m_showHelp = false;
+        std::vector<InputFile> m_inputFiles;
+    };
+
+    // Memory reused by a thread from one file to the next.
+    struct Worker
+    {
+        SrtFile m_srtFile;
+        std::vector<char> m_outputBuffer;
+
+        size_t m_fileCount = 0;
+        size_t m_failedCount = 0;
+        size_t m_subtitleCount = 0;
+        uintmax_t m_byteCount = 0;
+        SrtStats m_stats;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+#if defined(SRTFILE_STATS)
+    void PrintStats(const char* name, const SrtStats& stats)
+    {
+        fprintf(stderr,
+            "%s: scanned %llu bytes in %llu lines, %llu subtitles, %llu subtitle lines, %llu extra lines\n"
+            "%s: %llu bad timing lines, %llu end times fixed, %llu subtitle array growths, wrote %llu bytes\n"
+            "%s: read %.3f ms, parse %.3f ms, write %.3f ms\n",
+            name, (unsigned long long)stats.m_bytesScanned, (unsigned long long)stats.m_linesRead,
+            (unsigned long long)stats.m_cuesAccepted, (unsigned long long)stats.m_subtitleLines,
+            (unsigned long long)stats.m_extraLines,
+            name, (unsigned long long)stats.m_timingFailures, (unsigned long long)stats.m_endTimeFixups,
+            (unsigned long long)stats.m_subtitleArrayGrowths, (unsigned long long)stats.m_bytesWritten,
+            name, stats.m_readSeconds * 1000.0, stats.m_parseSeconds * 1000.0, stats.m_writeSeconds * 1000.0);
+    }
+#endif
+
+    void PrintUsage()
+    {
+        fprintf(stderr,
+            "Usage: srttool [options] [files...]\n"
+            "\n"
+            "Reads the standard input when no file is given, or for the file \"-\".\n"
+            "Results are written to the standard output unless -i or -d is used.\n"
+            "\n"
+            "Options:\n"
+            "  -o, --offset <ms>     Offset all timecodes by the given number of milliseconds\n"
+            "  -r, --renumber <n>    Renumber the subtitles starting at the given index\n"
+            "  -f, --fps <a>:<b>     Convert the times from the frame rate a to the frame rate b, given\n"
+            "                        as 25, 23.976 or 24000/1001, with an exact ratio\n"
+            "  -S, --snap            With -f, move the times to the nearest frame of the rate b\n"
+            "  -a, --anchor <s>=<t>  Move the time s, in milliseconds, to the time t, and the times\n"
+            "                        between anchors in proportion. Can be given several times\n"
+            "  -x, --fix-overlaps <policy>\n"
+            "                        Sort the subtitles by start time, and fix the ones overlapping\n"
+            "                        the previous one: trim (the previous one), push or merge\n"
+            "  -g, --min-gap <ms>    With -x, also fix the subtitles starting less than the given\n"
+            "                        time after the previous one\n"
+            "  -F, --from <ms>       Only change the subtitles starting at or after the given time,\n"
+            "                        in files sorted by start time\n"
+            "  -T, --to <ms>         Only change the subtitles starting before the given time\n"
+            "  -c, --cleanup         Remove all text that is not part of a subtitle\n"
+            "  -i, --in-place        Replace each input file with its result\n"
+            "  -p, --patch           With -i and only timing changes, rewrite the timecodes directly in\n"
+            "                        each file when they use the HH:MM:SS,mmm format and stay under\n"
+            "                        100 hours\n"
+            "  -d, --output-dir <d>  Write each result in the given directory, with the same name.\n"
+            "                        Files of -l and -R keep their path below their common directory\n"
+            "  -l, --list <file>     Also process the files listed in the given file, one per line\n"
+            "  -R, --recursive <d>   Also process all .srt files in the given directory tree\n"
+            "  -j, --jobs <n>        Process files on n threads, 0 for all hardware threads.\n"
+            "                        Only used with -i or -d, the standard output is written in order\n"
+            "  -t, --threads <n>     Parse large files on n threads, 0 for all hardware threads\n"
+            "  -s, --stats           Show the throughput of each file and of the whole batch\n"
+            "  -h, --help            Show this help\n");
+    }
+
+    bool ParseNumber(const char* text, long& value)
+    {
+        char* end = nullptr;
+        value = strtol(text, &end, 10);
+        return end != text && *end == '\0';
+    }
+
+    bool ParseOverlapPolicy(const char* text, SrtOverlapPolicy& policy)
+    {
+        const std::string name = text;
+        if (name == "trim")
+            policy = SrtOverlapPolicy::TrimPrevious;
+        else if (name == "push")
+            policy = SrtOverlapPolicy::PushNext;
+        else if (name == "merge")
+            policy = SrtOverlapPolicy::Merge;
+        else
+            return false;
+        return true;
+    }
+
+    // Frame rates are given as <source>:<target>.
+    bool ParseFrameRates(const char* text, SrtFrameRate& sourceRate, SrtFrameRate& targetRate)
+    {
+        const std::string_view rates = text;
+        const size_t separator = rates.find(':');
+        if (separator == std::string_view::npos)
+            return false;
+        sourceRate = SrtFrameRate::Parse(rates.substr(0, separator));
+        targetRate = SrtFrameRate::Parse(rates.substr(separator + 1));
+        return sourceRate.IsValid() && targetRate.IsValid();
+    }
+
+    // An anchor is given as <source>=<target>, in milliseconds.
+    bool ParseAnchor(const char* text, std::vector<SrtResyncAnchor>& anchors)
+    {
+        const std::string anchor = text;
+        const size_t separator = anchor.find('=');
+        long sourceTime = 0;
+        long targetTime = 0;
+        if (separator == std::string::npos || !ParseNumber(anchor.substr(0, separator).c_str(), sourceTime) ||
+            !ParseNumber(anchor.c_str() + separator + 1, targetTime))
+            return false;
+        anchors.push_back({ sourceTime, targetTime });
+        return true;
+    }
+
+    std::string GetFileName(const std::string& path)
+    {
+        const size_t nameStart = path.find_last_of("/\\");
+        return nameStart == std::string::npos ? path : path.substr(nameStart + 1);
+    }
+
+    bool AddListedFiles(const char* listPath, std::vector<InputFile>& inputFiles)
+    {
+        std::ifstream listFile;
+        if (std::string(listPath) != "-")
+        {
+            listFile.open(listPath);
+            if (!listFile)
+            {
+                fprintf(stderr, "srttool: cannot read the file list %s\n", listPath);
+                return false;
+            }
+        }
+
+        std::istream& list = listFile.is_open() ? listFile : std::cin;
+        std::string path;
+        std::vector<std::string> paths;
+        while (std::getline(list, path))
+        {
+            while (!path.empty() && (path.back() == '\r' || path.back() == ' '))
+                path.pop_back();
+            if (!path.empty())
+                paths.push_back(path);
+        }
+
+        // Like with -R, the results keep their path relative to the deepest directory holding all the files
+        namespace fs = std::filesystem;
+        std::error_code error;
+        std::vector<fs::path> fullPaths;
+        fs::path root;
+        for (const std::string& listedPath : paths)
+        {
+            fullPaths.push_back(fs::absolute(listedPath, error).lexically_normal());
+            const fs::path directory = fullPaths.back().parent_path();
+            if (fullPaths.size() == 1)
+            {
+                root = directory;
+                continue;
+            }
+
+            fs::path commonRoot;
+            for (auto it = root.begin(), dirIt = directory.begin(); it != root.end() && dirIt != directory.end() && *it == *dirIt; ++it, ++dirIt)
+                commonRoot /= *it;
+            root = commonRoot;
+        }
+
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            const std::string name = fullPaths[i].lexically_relative(root).string();
+            inputFiles.push_back({ paths[i], name.empty() ? GetFileName(paths[i]) : name });
+        }
+        return true;
+    }
+
+    // Flags the files whose result would overwrite the result of a file before them.
+    void FindSameOutputNames(std::vector<InputFile>& inputFiles)
+    {
+        namespace fs = std::filesystem;
+        std::unordered_set<std::string> names;
+        for (InputFile& inputFile : inputFiles)
+            inputFile.m_sameName = !names.insert(fs::path(inputFile.m_name).lexically_normal().string()).second;
+    }
+
+    bool AddDirectoryFiles(const char* dirPath, std::vector<InputFile>& inputFiles)
+    {
+        namespace fs = std::filesystem;
+        std::error_code error;
+        std::vector<InputFile> dirFiles;
+        for (fs::recursive_directory_iterator it(dirPath, error), end; !error && it != end; it.increment(error))
+        {
+            std::string extension = it->path().extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+            if (extension == ".srt" && it->is_regular_file(error))
+                dirFiles.push_back({ it->path().string(), it->path().lexically_relative(dirPath).string() });
+        }
+
+        if (error)
+        {
+            fprintf(stderr, "srttool: cannot read the directory %s\n", dirPath);
+            return false;
+        }
+
+        // Same order on all systems, and files of the same directory stay together
+        std::sort(dirFiles.begin(), dirFiles.end(), [](const InputFile& a, const InputFile& b) { return a.m_path < b.m_path; });
+        inputFiles.insert(inputFiles.end(), dirFiles.begin(), dirFiles.end());
+        return true;
+    }
+
+    bool ParseOptions(int argc, char* argv[], Options& options)
+    {
+        bool hasInputs = false;
+        std::vector<SrtResyncAnchor> anchors;
+        SrtFrameRate sourceRate;
+        SrtFrameRate targetRate;
+        bool snapToFrames = false;
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+            long value = 0;
+
+            if (arg == "-o" || arg == "--offset")
+            {
+                if (!hasValue || !ParseNumber(argv[++i], value))
+                    return false;
+                options.m_operations.m_timeOffset = value;
+            }
+            else if (arg == "-r" || arg == "--renumber")
+            {
+                if (!hasValue || !ParseNumber(argv[++i], value) || value <= 0)
+                    return false;
+                options.m_operations.m_startIndex = value;
+            }
+            else if (arg == "-f" || arg == "--fps")
+            {
+                if (!hasValue || !ParseFrameRates(argv[++i], sourceRate, targetRate))
+                    return false;
+            }
+            else if (arg == "-S" || arg == "--snap")
+            {
+                snapToFrames = true;
+            }
+            else if (arg == "-x" || arg == "--fix-overlaps")
+            {
+                if (!hasValue || !ParseOverlapPolicy(argv[++i], options.m_operations.m_overlapPolicy))
+                    return false;
+                options.m_operations.m_repairTimings = true;
+            }
+            else if (arg == "-g" || arg == "--min-gap")
+            {
+                if (!hasValue || !ParseNumber(argv[++i], value) || value < 0)
+                    return false;
+                options.m_operations.m_minGap = value;
+            }
+            else if (arg == "-a" || arg == "--anchor")
+            {
+                if (!hasValue || !ParseAnchor(argv[++i], anchors))
+                    return false;
+            }
+            else if (arg == "-F" || arg == "--from")
+            {
+                if (!hasValue || !ParseNumber(argv[++i], value))
+                    return false;
+                options.m_operations.m_rangeStart = value;
+            }
+            else if (arg == "-T" || arg == "--to")
+            {
+                if (!hasValue || !ParseNumber(argv[++i], value))
+                    return false;
+                options.m_operations.m_rangeEnd = value;
+            }
+            else if (arg == "-c" || arg == "--cleanup")
+            {
+                options.m_operations.m_removeExtra = true;
+            }
+            else if (arg == "-i" || arg == "--in-place")
+            {
+                options.m_inPlace = true;
+            }
+            else if (arg == "-p" || arg == "--patch")
+            {
+                options.m_patch = true;
+            }
+            else if (arg == "-d" || arg == "--output-dir")
+            {
+                if (!hasValue)
+                    return false;
+                options.m_outputDir = argv[++i];
+            }
+            else if (arg == "-l" || arg == "--list")
+            {
+                if (!hasValue || !AddListedFiles(argv[++i], options.m_inputFiles))
+                    return false;
+                hasInputs = true;
+            }
+            else if (arg == "-R" || arg == "--recursive")
+            {
+                if (!hasValue || !AddDirectoryFiles(argv[++i], options.m_inputFiles))
+                    return false;
+                hasInputs = true;
+            }
+            else if (arg == "-j" || arg == "--jobs")
+            {
+                if (!hasValue || !ParseNumber(argv[++i], value) || value < 0)
+                    return false;
+                options.m_jobCount = (unsigned)value;
+            }
+            else if (arg == "-t" || arg == "--threads")
+            {
+                if (!hasValue || !ParseNumber(argv[++i], value) || value < 0)
+                    return false;
+                options.m_threadCount = (unsigned)value;
+            }
+            else if (arg == "-s" || arg == "--stats")
+            {
+                options.m_showStats = true;
+            }
+            else if (arg == "-h" || arg == "--help")
+            {
+                options.m_showHelp = true;
+            }
+            else if (arg.size() > 1 && arg[0] == '-')
+            {
+                return false;
+            }
+            else
+            {
+                options.m_inputFiles.push_back({ arg, GetFileName(arg) });
+                hasInputs = true;
+            }
+        }
+
+        if (!anchors.empty())
+            options.m_operations.m_resync.SetAnchors(std::move(anchors));
+        if (sourceRate.IsValid())
+        {
+            options.m_operations.m_frameRate = SrtFrameRateConversion(sourceRate, targetRate, snapToFrames);
+            if (options.m_operations.m_frameRate.IsEmpty())
+                return false;
+        }
+        if (!hasInputs)
+            options.m_inputFiles.push_back({ "-", "-" });
+        return !(options.m_inPlace && !options.m_outputDir.empty());
+    }
+
+    std::string GetOutputPath(const InputFile& inputFile, const Options& options)
+    {
+        if (options.m_inPlace)
+            return inputFile.m_path;
+        if (options.m_outputDir.empty())
+            return std::string();
+        return options.m_outputDir + "/" + inputFile.m_name;
+    }
+
+    // Writes to a temporary file next to the destination, then renames it over the destination.
+    bool WriteFileAtomic(const std::string& path, const char* data, size_t size, size_t workerIndex)
+    {
+        namespace fs = std::filesystem;
+        std::error_code error;
+        const fs::path parentPath = fs::path(path).parent_path();
+        if (!parentPath.empty())
+            fs::create_directories(parentPath, error);
+
+        const std::string tempPath = path + ".srttool" + std::to_string(workerIndex) + ".tmp";
+        FILE* file = fopen(tempPath.c_str(), "wb");
+        if (!file)
+            return false;
+        bool success = fwrite(data, 1, size, file) == size;
+        success = fclose(file) == 0 && success;
+
+        if (success)
+        {
+            fs::rename(tempPath, path, error);
+            success = !error;
+        }
+        if (!success)
+            fs::remove(tempPath, error);
+        return success;
+    }
+
+    // Processes one file with the memory of the given worker.
+    bool ProcessFile(const InputFile& inputFile, const Options& options, Worker& worker, size_t workerIndex)
+    {
+        const SrtStreamOperations& operations = options.m_operations;
+        const std::string outputPath = GetOutputPath(inputFile, options);
+        const Clock::time_point startTime = Clock::now();
+        size_t subtitleCount = 0;
+        uintmax_t byteCount = 0;
+
+        const bool isStandardInput = inputFile.m_path == "-";
+        if (isStandardInput && !outputPath.empty())
+        {
+            fprintf(stderr, "srttool: cannot write the standard input to a file\n");
+            return false;
+        }
+        if (inputFile.m_sameName && !options.m_inPlace && !outputPath.empty())
+        {
+            fprintf(stderr, "srttool: %s would overwrite the result of another file in %s\n", inputFile.m_path.c_str(), outputPath.c_str());
+            return false;
+        }
+
+        // Repairing the timings needs all the subtitles, so the standard input is then read as a whole
+        if (isStandardInput && !operations.m_repairTimings)
+        {
+            subtitleCount = TransformSrtStream(std::cin, std::cout, operations);
+            if (subtitleCount == 0)
+            {
+                fprintf(stderr, "srttool: no subtitles found in the standard input\n");
+                return false;
+            }
+        }
+        else
+        {
+            // Timing changes alone can be patched into the mapped file, without writing it again
+            const bool patch = options.m_patch && options.m_inPlace && operations.m_startIndex == 0 && !operations.m_removeExtra;
+            SrtFile& srtFile = worker.m_srtFile;
+            srtFile.SetRecordTimings(patch);
+            const bool loaded = isStandardInput ? srtFile.ReadFromFile(std::cin, options.m_threadCount) && srtFile.IsValid() :
+                srtFile.LoadMapped(inputFile.m_path.c_str(), options.m_threadCount, patch);
+            if (!loaded)
+            {
+                fprintf(stderr, "srttool: cannot read %s, or it has no subtitles\n", inputFile.m_path.c_str());
+                return false;
+            }
+
+            operations.ApplyTo(srtFile);
+            subtitleCount = srtFile.m_subtitles.size();
+            SrtStats stats = srtFile.GetStats();
+            const bool patched = patch && srtFile.PatchMappedTimings(&stats);
+
+            std::vector<char>& outputBuffer = worker.m_outputBuffer;
+            size_t outputSize = 0;
+            if (!patched)
+            {
+                outputSize = srtFile.ComputeSerializedSize(operations.m_removeExtra);
+                if (outputBuffer.size() < outputSize)
+                    outputBuffer.resize(outputSize);
+                srtFile.WriteToBuffer(outputBuffer.data(), outputSize, operations.m_removeExtra, &stats);
+            }
+
+            SRTFILE_STAT(if (options.m_showStats) PrintStats(inputFile.m_path.c_str(), stats));
+            SRTFILE_STAT(worker.m_stats.Add(stats));
+
+            // Release the mapped input before replacing the file
+            srtFile.Reset();
+
+            // A patched file already has its new timecodes
+            if (!patched && outputPath.empty())
+            {
+                std::cout.write(outputBuffer.data(), (std::streamsize)outputSize);
+                if (!std::cout.good())
+                    return false;
+            }
+            else if (!patched && !WriteFileAtomic(outputPath, outputBuffer.data(), outputSize, workerIndex))
+            {
+                fprintf(stderr, "srttool: cannot write %s\n", outputPath.c_str());
+                return false;
+            }
+
+            if (options.m_showStats && !isStandardInput)
+            {
+                std::error_code error;
+                byteCount = std::filesystem::file_size(inputFile.m_path, error);
+            }
+        }
+
+        if (options.m_showStats)
+        {
+            const double seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+            fprintf(stderr, "%s: %zu subtitles, %.1f KB in %.3f ms, %.1f MB/s\n", inputFile.m_path.c_str(), subtitleCount,
+                byteCount / 1024.0, seconds * 1000.0, seconds > 0.0 ? byteCount / (seconds * 1024.0 * 1024.0) : 0.0);
+        }
+
+        worker.m_subtitleCount += subtitleCount;
+        worker.m_byteCount += byteCount;
+        return true;
+    }
+
+    // Runs tasks on several threads. Each thread starts with its own share of the tasks,
+    // and steals from the end of the other threads' shares once it is done with its own,
+    // so a few large files don't keep the other threads waiting.
+    class WorkStealingPool
+    {
+    public:
+        WorkStealingPool(size_t threadCount, size_t taskCount) : m_queues(threadCount)
+        {
+            // Contiguous shares keep the files of a directory on the same thread
+            for (size_t task = 0; task < taskCount; task++)
+                m_queues[task * threadCount / taskCount].m_tasks.push_back(task);
+        }
+
+        // Calls function(threadIndex, taskIndex) for all tasks, and returns when they are done.
+        template <typename Function>
+        void Run(Function function)
+        {
+            std::vector<std::thread> threads;
+            for (size_t threadIndex = 1; threadIndex < m_queues.size(); threadIndex++)
+                threads.emplace_back([this, &function, threadIndex]() { RunTasks(threadIndex, function); });
+            RunTasks(0, function);
+            for (std::thread& thread : threads)
+                thread.join();
+        }
+
+    private:
+        struct Queue
+        {
+            std::mutex m_mutex;
+            std::deque<size_t> m_tasks;
+        };
+
+        template <typename Function>
+        void RunTasks(size_t threadIndex, Function& function)
+        {
+            size_t task;
+            while (PopTask(threadIndex, task))
+                function(threadIndex, task);
+        }
+
+        // No task is added while running, so all tasks are done once all queues are empty.
+        bool PopTask(size_t threadIndex, size_t& task)
+        {
+            for (size_t i = 0; i < m_queues.size(); i++)
+            {
+                Queue& queue = m_queues[(threadIndex + i) % m_queues.size()];
+                std::lock_guard<std::mutex> lock(queue.m_mutex);
+                if (queue.m_tasks.empty())
+                    continue;
+
+                if (i == 0)
+                {
+                    task = queue.m_tasks.front();
+                    queue.m_tasks.pop_front();
+                }
+                else
+                {
+                    task = queue.m_tasks.back();
+                    queue.m_tasks.pop_back();
+                }
+                return true;
+            }
+            return false;
+        }
+
+        std::vector<Queue> m_queues;
+    };
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options) || options.m_showHelp)
+    {
+        PrintUsage();
+        return options.m_showHelp ? 0 : 2;
+    }
+
+    std::ios::sync_with_stdio(false);
+#if defined(_WIN32)
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    FindSameOutputNames(options.m_inputFiles);
+
+    // Results written to the standard output must stay in order
+    size_t jobCount = options.m_jobCount == 0 ? std::max(std::thread::hardware_concurrency(), 1u) : options.m_jobCount;
+    if (!options.m_inPlace && options.m_outputDir.empty())
+        jobCount = 1;
+    jobCount = std::max<size_t>(std::min(jobCount, options.m_inputFiles.size()), 1);
+
+    const Clock::time_point startTime = Clock::now();
+    std::vector<Worker> workers(jobCount);
+    WorkStealingPool pool(jobCount, options.m_inputFiles.size());
+    pool.Run([&](size_t workerIndex, size_t fileIndex)
+    {
+        Worker& worker = workers[workerIndex];
+        worker.m_fileCount++;
+        if (!ProcessFile(options.m_inputFiles[fileIndex], options, worker, workerIndex))
+            worker.m_failedCount++;
+    });
+    std::cout.flush();
+
+    Worker total;
+    for (const Worker& worker : workers)
+    {
+        total.m_fileCount += worker.m_fileCount;
+        total.m_failedCount += worker.m_failedCount;
+        total.m_subtitleCount += worker.m_subtitleCount;
+        total.m_byteCount += worker.m_byteCount;
+        total.m_stats.Add(worker.m_stats);
+    }
+
+    if (options.m_showStats)
+    {
+        const double seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+        const double megabytes = total.m_byteCount / (1024.0 * 1024.0);
+        fprintf(stderr, "srttool: %zu files (%zu failed), %zu subtitles, %.1f MB in %.3f s on %zu threads, %.1f MB/s, %.0f files/s\n",
+            total.m_fileCount, total.m_failedCount, total.m_subtitleCount, megabytes, seconds, jobCount,
+            seconds > 0.0 ? megabytes / seconds : 0.0, seconds > 0.0 ? total.m_fileCount / seconds : 0.0);
+        SRTFILE_STAT(PrintStats("srttool", total.m_stats));
+    }
+
+    return total.m_failedCount == 0 ? 0 : 1;
+}